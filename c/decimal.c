@@ -0,0 +1,569 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "jmp.h"
+
+/* Powers of ten below this are computed once per thread and kept. */
+#define JMP_DECIMAL_POW_CACHE 128
+
+/* Largest supported scale, so sums of two scales never overflow. */
+#define JMP_DECIMAL_MAX_SCALE (1 << 24)
+
+/* The value coeff * 10^-scale, scale never negative. */
+typedef struct {
+    mpz_t coeff;
+    int32_t scale;
+} JmpDecimal;
+
+typedef enum {
+    JMP_ROUND_HALF_EVEN,
+    JMP_ROUND_HALF_UP,
+    JMP_ROUND_HALF_DOWN,
+    JMP_ROUND_UP,
+    JMP_ROUND_DOWN,
+    JMP_ROUND_FLOOR,
+    JMP_ROUND_CEILING
+} JmpRound;
+
+static Janet cfun_decimal_add_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_sub_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_subi_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_mul_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_div_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_divi_method(int32_t argc, Janet *argv);
+static Janet cfun_decimal_compare_method(int32_t argc, Janet *argv);
+
+/******************/
+/* Powers of ten  */
+/******************/
+
+static JANET_THREAD_LOCAL int pow10_count = 0;
+static JANET_THREAD_LOCAL mpz_t pow10_cache[JMP_DECIMAL_POW_CACHE];
+
+/* 10^k, from the cache or computed into tmp. */
+static mpz_srcptr decimal_pow10(int32_t k, mpz_ptr tmp) {
+    if (k < JMP_DECIMAL_POW_CACHE) {
+        while (pow10_count <= k) {
+            mpz_ptr next = pow10_cache[pow10_count];
+            if (pow10_count == 0)
+                mpz_init_set_ui(next, 1);
+            else {
+                mpz_init(next);
+                mpz_mul_ui(next, pow10_cache[pow10_count - 1], 10);
+            }
+            pow10_count++;
+        }
+        return pow10_cache[k];
+    }
+    mpz_ui_pow_ui(tmp, 10, (unsigned long)k);
+    return tmp;
+}
+
+static void mul_pow10(mpz_ptr rop, mpz_srcptr op, int32_t k) {
+    if (k == 0) {
+        mpz_set(rop, op);
+        return;
+    }
+    mpz_t tmp;
+    mpz_init(tmp);
+    mpz_mul(rop, op, decimal_pow10(k, tmp));
+    mpz_clear(tmp);
+}
+
+/************/
+/* Rounding */
+/************/
+
+/* q = n / d rounded by mode. q may alias n. */
+static void div_round(mpz_ptr q, mpz_srcptr n, mpz_srcptr d, JmpRound mode) {
+    int sign = mpz_sgn(n) * mpz_sgn(d);
+    mpz_t r;
+    mpz_init(r);
+    mpz_tdiv_qr(q, r, n, d);
+    if (mpz_sgn(r) != 0) {
+        int away = 0;
+        switch (mode) {
+            case JMP_ROUND_UP:
+                away = 1;
+                break;
+            case JMP_ROUND_DOWN:
+                away = 0;
+                break;
+            case JMP_ROUND_FLOOR:
+                away = sign < 0;
+                break;
+            case JMP_ROUND_CEILING:
+                away = sign > 0;
+                break;
+            default: {
+                mpz_mul_2exp(r, r, 1);
+                int c = mpz_cmpabs(r, d);
+                if (c != 0)
+                    away = c > 0;
+                else if (mode == JMP_ROUND_HALF_UP)
+                    away = 1;
+                else if (mode == JMP_ROUND_HALF_EVEN)
+                    away = mpz_odd_p(q);
+                break;
+            }
+        }
+        if (away) {
+            if (sign > 0)
+                mpz_add_ui(q, q, 1);
+            else
+                mpz_sub_ui(q, q, 1);
+        }
+    }
+    mpz_clear(r);
+}
+
+static void div_pow10_round(mpz_ptr rop, mpz_srcptr op, int32_t k, JmpRound mode) {
+    if (k == 0) {
+        mpz_set(rop, op);
+        return;
+    }
+    mpz_t tmp;
+    mpz_init(tmp);
+    div_round(rop, op, decimal_pow10(k, tmp), mode);
+    mpz_clear(tmp);
+}
+
+static JmpRound optround(const Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL))
+        return JMP_ROUND_HALF_EVEN;
+    const uint8_t *mode = janet_getkeyword(argv, n);
+    if (!janet_cstrcmp(mode, "half-even")) return JMP_ROUND_HALF_EVEN;
+    if (!janet_cstrcmp(mode, "half-up")) return JMP_ROUND_HALF_UP;
+    if (!janet_cstrcmp(mode, "half-down")) return JMP_ROUND_HALF_DOWN;
+    if (!janet_cstrcmp(mode, "up")) return JMP_ROUND_UP;
+    if (!janet_cstrcmp(mode, "down")) return JMP_ROUND_DOWN;
+    if (!janet_cstrcmp(mode, "floor")) return JMP_ROUND_FLOOR;
+    if (!janet_cstrcmp(mode, "ceiling")) return JMP_ROUND_CEILING;
+    janet_panicf("unknown rounding mode %v", argv[n]);
+    return JMP_ROUND_HALF_EVEN;
+}
+
+static int32_t checkscale(int64_t scale) {
+    if (scale < 0 || scale > JMP_DECIMAL_MAX_SCALE)
+        janet_panicf("scale %d out of range", (int32_t)scale);
+    return (int32_t)scale;
+}
+
+static int32_t optscale(const Janet *argv, int32_t argc, int32_t n, int32_t dflt) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL))
+        return dflt;
+    return checkscale(janet_getinteger(argv, n));
+}
+
+/********/
+/* Type */
+/********/
+
+static int decimal_gc(void *data, size_t len)
+{
+    (void) len;
+    mpz_clear(((JmpDecimal *)data)->coeff);
+    return 0;
+}
+
+static JanetMethod decimal_methods[] = {
+    {"+", cfun_decimal_add_method},
+    {"r+", cfun_decimal_add_method},
+    {"-", cfun_decimal_sub_method},
+    {"r-", cfun_decimal_subi_method},
+    {"*", cfun_decimal_mul_method},
+    {"r*", cfun_decimal_mul_method},
+    {"/", cfun_decimal_div_method},
+    {"r/", cfun_decimal_divi_method},
+    {"compare", cfun_decimal_compare_method},
+    {NULL, NULL}
+};
+
+static int decimal_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), decimal_methods, out);
+}
+
+static Janet decimal_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(decimal_methods, key);
+}
+
+/* Digits of the coefficient with the point inserted scale digits from
+ * the right, padded with zeros as needed. */
+static void decimal_tostring(void *p, JanetBuffer *buffer) {
+    JmpDecimal *dec = (JmpDecimal *)p;
+    char *str = janet_smalloc(mpz_sizeinbase(dec->coeff, 10) + 2);
+    mpz_get_str(str, 10, dec->coeff);
+    const char *digits = str;
+    if (*digits == '-') {
+        janet_buffer_push_u8(buffer, '-');
+        digits++;
+    }
+    int32_t ndigits = (int32_t)strlen(digits);
+    if (dec->scale == 0) {
+        janet_buffer_push_cstring(buffer, digits);
+    } else if (ndigits <= dec->scale) {
+        janet_buffer_push_cstring(buffer, "0.");
+        for (int32_t i = ndigits; i < dec->scale; i++)
+            janet_buffer_push_u8(buffer, '0');
+        janet_buffer_push_cstring(buffer, digits);
+    } else {
+        janet_buffer_push_bytes(buffer, (const uint8_t *)digits, ndigits - dec->scale);
+        janet_buffer_push_u8(buffer, '.');
+        janet_buffer_push_cstring(buffer, digits + ndigits - dec->scale);
+    }
+    janet_sfree(str);
+}
+
+static int decimal_cmp(const JmpDecimal *a, const JmpDecimal *b) {
+    if (a->scale == b->scale)
+        return mpz_cmp(a->coeff, b->coeff);
+    mpz_t x;
+    mpz_init(x);
+    int c;
+    if (a->scale < b->scale) {
+        mul_pow10(x, a->coeff, b->scale - a->scale);
+        c = mpz_cmp(x, b->coeff);
+    } else {
+        mul_pow10(x, b->coeff, a->scale - b->scale);
+        c = mpz_cmp(a->coeff, x);
+    }
+    mpz_clear(x);
+    return c;
+}
+
+static int decimal_compare(void *p1, void *p2) {
+    return decimal_cmp((JmpDecimal *)p1, (JmpDecimal *)p2);
+}
+
+const JanetAbstractType jmp_decimal_type = {
+    "jmp/decimal",
+    decimal_gc,
+    NULL,
+    decimal_get,
+    NULL,
+    NULL,
+    NULL,
+    decimal_tostring,
+    decimal_compare,
+    NULL,
+    decimal_next,
+    JANET_ATEND_NEXT
+};
+
+/**************/
+/* Conversion */
+/**************/
+
+static JmpDecimal *decimal_new(int32_t scale) {
+    JmpDecimal *dec = janet_abstract(&jmp_decimal_type, sizeof(JmpDecimal));
+    mpz_init(dec->coeff);
+    dec->scale = scale;
+    return dec;
+}
+
+/* Parse [+-]digits[.digits][(e|E)[+-]digits] into dec. The digits go
+ * through mpz_set_str in one piece. */
+static int decimal_parse(JmpDecimal *dec, const uint8_t *str, int32_t len) {
+    char *digits = janet_smalloc((size_t)len + 2);
+    int32_t ndigits = 0, frac = 0, i = 0;
+    int point = 0;
+    int64_t exponent = 0;
+    if (i < len && (str[i] == '-' || str[i] == '+')) {
+        if (str[i++] == '-')
+            digits[ndigits++] = '-';
+    }
+    int32_t first = ndigits;
+    for (; i < len; i++) {
+        if (str[i] >= '0' && str[i] <= '9') {
+            digits[ndigits++] = (char)str[i];
+            frac += point;
+        } else if (str[i] == '.' && !point) {
+            point = 1;
+        } else {
+            break;
+        }
+    }
+    int ok = ndigits > first;
+    if (ok && i < len && (str[i] == 'e' || str[i] == 'E')) {
+        int negative = 0;
+        i++;
+        if (i < len && (str[i] == '-' || str[i] == '+'))
+            negative = str[i++] == '-';
+        ok = i < len;
+        for (; ok && i < len && str[i] >= '0' && str[i] <= '9'; i++)
+            if (exponent <= JMP_DECIMAL_MAX_SCALE)
+                exponent = exponent * 10 + (str[i] - '0');
+        if (negative)
+            exponent = -exponent;
+    }
+    ok = ok && i == len;
+    if (ok) {
+        digits[ndigits] = '\0';
+        mpz_set_str(dec->coeff, digits, 10);
+        int64_t scale = frac - exponent;
+        if (scale < 0) {
+            ok = -scale <= JMP_DECIMAL_MAX_SCALE;
+            if (ok)
+                mul_pow10(dec->coeff, dec->coeff, (int32_t)-scale);
+            scale = 0;
+        }
+        ok = ok && scale <= JMP_DECIMAL_MAX_SCALE;
+        dec->scale = (int32_t)scale;
+    }
+    janet_sfree(digits);
+    return ok;
+}
+
+/* A decimal from a number, string, integer or decimal. Numbers use the
+ * shortest form that reads back as the same double, so 0.1 is 1/10. */
+static JmpDecimal *decimal_from(Janet x) {
+    JmpDecimal *dec = janet_checkabstract(x, &jmp_decimal_type);
+    if (dec)
+        return dec;
+    dec = decimal_new(0);
+    if (janet_checktype(x, JANET_NUMBER)) {
+        double d = janet_unwrap_number(x);
+        if (!isfinite(d))
+            janet_panicf("can not convert %v to a decimal", x);
+        if (d == floor(d) && fabs(d) < 9007199254740992.0) {
+            mpz_set_d(dec->coeff, d);
+            return dec;
+        }
+        char buf[32];
+        for (int precision = 1; precision <= 17; precision++) {
+            snprintf(buf, sizeof(buf), "%.*g", precision, d);
+            if (strtod(buf, NULL) == d)
+                break;
+        }
+        decimal_parse(dec, (const uint8_t *)buf, (int32_t)strlen(buf));
+    } else if (janet_checktypes(x, JANET_TFLAG_BYTES)) {
+        JanetByteView bytes;
+        janet_bytes_view(x, &bytes.bytes, &bytes.len);
+        if (!decimal_parse(dec, bytes.bytes, bytes.len))
+            janet_panicf("invalid decimal %v", x);
+    } else {
+        mpz_clear(dec->coeff);
+        janet_unwrap_mpz(x, dec->coeff);
+    }
+    return dec;
+}
+
+/* A copy of dec at scale, rounded by mode when digits are dropped. */
+static JmpDecimal *decimal_rescale(const JmpDecimal *dec, int32_t scale, JmpRound mode) {
+    JmpDecimal *out = decimal_new(scale);
+    if (scale >= dec->scale)
+        mul_pow10(out->coeff, dec->coeff, scale - dec->scale);
+    else
+        div_pow10_round(out->coeff, dec->coeff, dec->scale - scale, mode);
+    return out;
+}
+
+/**************/
+/* Arithmetic */
+/**************/
+
+static JmpDecimal *decimal_add_sub(const JmpDecimal *a, const JmpDecimal *b, int subtract) {
+    int32_t scale = a->scale > b->scale ? a->scale : b->scale;
+    JmpDecimal *out = decimal_new(scale);
+    mpz_t tmp;
+    mpz_init(tmp);
+    mul_pow10(out->coeff, a->coeff, scale - a->scale);
+    mul_pow10(tmp, b->coeff, scale - b->scale);
+    if (subtract)
+        mpz_sub(out->coeff, out->coeff, tmp);
+    else
+        mpz_add(out->coeff, out->coeff, tmp);
+    mpz_clear(tmp);
+    return out;
+}
+
+/* Product at scale, exact when scale is at least the sum of scales. */
+static JmpDecimal *decimal_mul(const JmpDecimal *a, const JmpDecimal *b, int32_t scale, JmpRound mode) {
+    JmpDecimal *out = decimal_new(scale);
+    int32_t exact = a->scale + b->scale;
+    mpz_mul(out->coeff, a->coeff, b->coeff);
+    if (scale >= exact)
+        mul_pow10(out->coeff, out->coeff, scale - exact);
+    else
+        div_pow10_round(out->coeff, out->coeff, exact - scale, mode);
+    return out;
+}
+
+/* Quotient at scale: a.coeff * 10^(scale - a.scale + b.scale) / b.coeff
+ * rounded once by mode. */
+static JmpDecimal *decimal_div(const JmpDecimal *a, const JmpDecimal *b, int32_t scale, JmpRound mode) {
+    if (mpz_sgn(b->coeff) == 0)
+        janet_panic("division by zero");
+    JmpDecimal *out = decimal_new(scale);
+    int64_t shift = (int64_t)scale - a->scale + b->scale;
+    mpz_t num, den;
+    mpz_init(num);
+    mpz_init(den);
+    mul_pow10(num, a->coeff, shift > 0 ? (int32_t)shift : 0);
+    mul_pow10(den, b->coeff, shift < 0 ? (int32_t)-shift : 0);
+    div_round(out->coeff, num, den, mode);
+    mpz_clear(num);
+    mpz_clear(den);
+    return out;
+}
+
+static int32_t max_scale(const JmpDecimal *a, const JmpDecimal *b) {
+    return a->scale > b->scale ? a->scale : b->scale;
+}
+
+static Janet decimal_binop(char op, Janet x, Janet y) {
+    JmpDecimal *a = decimal_from(x);
+    JmpDecimal *b = decimal_from(y);
+    switch (op) {
+        case '+':
+            return janet_wrap_abstract(decimal_add_sub(a, b, 0));
+        case '-':
+            return janet_wrap_abstract(decimal_add_sub(a, b, 1));
+        case '*':
+            return janet_wrap_abstract(decimal_mul(a, b, checkscale((int64_t)a->scale + b->scale), JMP_ROUND_HALF_EVEN));
+        default:
+            return janet_wrap_abstract(decimal_div(a, b, max_scale(a, b), JMP_ROUND_HALF_EVEN));
+    }
+}
+
+/***********/
+/* Methods */
+/***********/
+
+static Janet cfun_decimal_add_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('+', argv[0], argv[1]);
+}
+
+static Janet cfun_decimal_sub_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('-', argv[0], argv[1]);
+}
+
+static Janet cfun_decimal_subi_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('-', argv[1], argv[0]);
+}
+
+static Janet cfun_decimal_mul_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('*', argv[0], argv[1]);
+}
+
+static Janet cfun_decimal_div_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('/', argv[0], argv[1]);
+}
+
+static Janet cfun_decimal_divi_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    return decimal_binop('/', argv[1], argv[0]);
+}
+
+static Janet cfun_decimal_compare_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpDecimal *a = janet_getabstract(argv, 0, &jmp_decimal_type);
+    if (!janet_checktype(argv[1], JANET_NUMBER) && !janet_checktype(argv[1], JANET_ABSTRACT))
+        return janet_wrap_nil();
+    JmpDecimal *b = decimal_from(argv[1]);
+    int c = decimal_cmp(a, b);
+    return janet_wrap_number((c > 0) - (c < 0));
+}
+
+JANET_FN(cfun_decimal_new,
+         "(jmp/decimal value &opt scale mode)",
+         "Create a fixed-point decimal from a string like \"-12.345\" or "
+         "\"1.5e3\", a number, an integer or another decimal. With scale the "
+         "value is rounded by mode to that many fraction digits. Supports "
+         "+, -, * and / with decimals, integers and numbers; * is exact and "
+         "/ rounds to the larger scale of its operands, half to even.") {
+    janet_arity(argc, 1, 3);
+    JmpDecimal *dec = decimal_from(argv[0]);
+    int32_t scale = optscale(argv, argc, 1, dec->scale);
+    JmpRound mode = optround(argv, argc, 2);
+    if (scale == dec->scale)
+        return janet_wrap_abstract(dec);
+    return janet_wrap_abstract(decimal_rescale(dec, scale, mode));
+}
+
+JANET_FN(cfun_decimal_scale,
+         "(jmp/decimal-scale d)",
+         "Number of fraction digits of d.") {
+    janet_fixarity(argc, 1);
+    JmpDecimal *dec = janet_getabstract(argv, 0, &jmp_decimal_type);
+    return janet_wrap_integer(dec->scale);
+}
+
+JANET_FN(cfun_decimal_coeff,
+         "(jmp/decimal-coeff d)",
+         "Unscaled coefficient of d as a jmp/mpz, d times 10^scale.") {
+    janet_fixarity(argc, 1);
+    JmpDecimal *dec = janet_getabstract(argv, 0, &jmp_decimal_type);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init_set(box, dec->coeff);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_decimal_round,
+         "(jmp/decimal-round d scale &opt mode)",
+         "d with scale fraction digits. Dropped digits are rounded by mode, "
+         "one of :half-even (the default), :half-up, :half-down, :up, :down, "
+         ":floor or :ceiling.") {
+    janet_arity(argc, 2, 3);
+    JmpDecimal *dec = decimal_from(argv[0]);
+    int32_t scale = checkscale(janet_getinteger(argv, 1));
+    return janet_wrap_abstract(decimal_rescale(dec, scale, optround(argv, argc, 2)));
+}
+
+JANET_FN(cfun_decimal_mul,
+         "(jmp/decimal-mul a b &opt scale mode)",
+         "Product of a and b with scale fraction digits, rounded once by "
+         "mode. Without scale the product is exact.") {
+    janet_arity(argc, 2, 4);
+    JmpDecimal *a = decimal_from(argv[0]);
+    JmpDecimal *b = decimal_from(argv[1]);
+    int32_t scale = optscale(argv, argc, 2, checkscale((int64_t)a->scale + b->scale));
+    return janet_wrap_abstract(decimal_mul(a, b, scale, optround(argv, argc, 3)));
+}
+
+JANET_FN(cfun_decimal_div,
+         "(jmp/decimal-div a b &opt scale mode)",
+         "Quotient of a and b with scale fraction digits, by default the "
+         "larger scale of a and b, rounded once by mode.") {
+    janet_arity(argc, 2, 4);
+    JmpDecimal *a = decimal_from(argv[0]);
+    JmpDecimal *b = decimal_from(argv[1]);
+    int32_t scale = optscale(argv, argc, 2, max_scale(a, b));
+    return janet_wrap_abstract(decimal_div(a, b, scale, optround(argv, argc, 3)));
+}
+
+JANET_FN(cfun_decimal_to_mpz,
+         "(jmp/decimal->mpz d &opt mode)",
+         "d rounded to an integer by mode.") {
+    janet_arity(argc, 1, 2);
+    JmpDecimal *dec = decimal_from(argv[0]);
+    JmpRound mode = optround(argv, argc, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    div_pow10_round(box, dec->coeff, dec->scale, mode);
+    return janet_wrap_abstract(box);
+}
+
+void jmp_lib_decimal(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("decimal", cfun_decimal_new),
+        JANET_REG("decimal-scale", cfun_decimal_scale),
+        JANET_REG("decimal-coeff", cfun_decimal_coeff),
+        JANET_REG("decimal-round", cfun_decimal_round),
+        JANET_REG("decimal-mul", cfun_decimal_mul),
+        JANET_REG("decimal-div", cfun_decimal_div),
+        JANET_REG("decimal->mpz", cfun_decimal_to_mpz),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_decimal_type);
+}
@@ -0,0 +1,418 @@
+#include <ctype.h>
+#include "jmp.h"
+
+/* Number of digits (or bytes for the raw format) converted at once. Only
+ * pieces of this size are ever materialized as text. */
+#define JMP_IO_CHUNK 4096
+
+/* Enough for any number of chunk doublings on a 64 bit machine. */
+#define JMP_IO_MAX_LEVELS 64
+
+typedef enum {
+    JMP_FORMAT_DEC,
+    JMP_FORMAT_HEX,
+    JMP_FORMAT_BIN
+} JmpFormat;
+
+static JmpFormat jmp_optformat(Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL) || janet_keyeq(argv[n], "dec"))
+        return JMP_FORMAT_DEC;
+    if (janet_keyeq(argv[n], "hex"))
+        return JMP_FORMAT_HEX;
+    if (janet_keyeq(argv[n], "bin"))
+        return JMP_FORMAT_BIN;
+    janet_panicf("unknown format %v, expected :dec, :hex or :bin", argv[n]);
+}
+
+/* The masks match the ones Janet's own file functions accept, so files
+ * opened with :a or :r+ can be used as well. */
+#define JMP_FILE_WRITABLE (JANET_FILE_WRITE | JANET_FILE_APPEND | JANET_FILE_UPDATE)
+#define JMP_FILE_READABLE (JANET_FILE_READ | JANET_FILE_UPDATE)
+
+static FILE *jmp_checkopenfile(Janet x, int32_t mask) {
+    int32_t flags;
+    FILE *file = janet_unwrapfile(x, &flags);
+    if (flags & JANET_FILE_CLOSED)
+        janet_panic("file is closed");
+    if (!(flags & mask))
+        janet_panicf("file is not %s", (mask & JANET_FILE_WRITE) ? "writable" : "readable");
+    return file;
+}
+
+/**********/
+/* Output */
+/**********/
+
+typedef struct {
+    FILE *file;
+    JanetBuffer *buffer;
+    int failed;
+} JmpSink;
+
+static void sink_write(JmpSink *sink, const char *data, size_t len) {
+    if (sink->failed || len == 0)
+        return;
+    if (sink->file) {
+        if (fwrite(data, 1, len, sink->file) != len)
+            sink->failed = 1;
+    } else {
+        janet_buffer_push_bytes(sink->buffer, (const uint8_t *)data, (int32_t)len);
+    }
+}
+
+static const char zeros[64] = "0000000000000000000000000000000000000000000000000000000000000000";
+
+static void sink_zeros(JmpSink *sink, size_t count) {
+    while (count > 0) {
+        size_t n = count < sizeof(zeros) ? count : sizeof(zeros);
+        sink_write(sink, zeros, n);
+        count -= n;
+    }
+}
+
+/* Write x < 10^(JMP_IO_CHUNK * 2^level). powers[i] holds
+ * 10^(JMP_IO_CHUNK * 2^i). If width is non-zero the digits are left
+ * padded with zeros to exactly width characters. */
+static void write_dec_rec(JmpSink *sink, mpz_srcptr x, int level, mpz_t *powers,
+                          size_t width, char *scratch) {
+    if (level == 0) {
+        if (width == 0 && mpz_sgn(x) == 0)
+            return;
+        mpz_get_str(scratch, 10, x);
+        size_t len = mpz_sgn(x) == 0 ? 0 : strlen(scratch);
+        if (width > len)
+            sink_zeros(sink, width - len);
+        sink_write(sink, scratch, len);
+        return;
+    }
+    size_t half = (size_t)JMP_IO_CHUNK << (level - 1);
+    mpz_t q, r;
+    mpz_init(q);
+    mpz_init(r);
+    mpz_tdiv_qr(q, r, x, powers[level - 1]);
+    if (width == 0 && mpz_sgn(q) == 0) {
+        mpz_clear(q);
+        write_dec_rec(sink, r, level - 1, powers, 0, scratch);
+    } else {
+        write_dec_rec(sink, q, level - 1, powers, width ? half : 0, scratch);
+        mpz_clear(q);
+        write_dec_rec(sink, r, level - 1, powers, half, scratch);
+    }
+    mpz_clear(r);
+}
+
+/* Divide and conquer radix conversion. The number is split at powers of
+ * ten until the pieces are at most JMP_IO_CHUNK digits, which are written
+ * out in order. The extra memory is a small multiple of the size of x. */
+static void write_dec(JmpSink *sink, mpz_srcptr x) {
+    if (mpz_sgn(x) == 0) {
+        sink_write(sink, "0", 1);
+        return;
+    }
+    /* mpz_sizeinbase is exact or one too large, so x fits in levels
+     * either way; an extra level only produces a zero quotient. */
+    size_t digits = mpz_sizeinbase(x, 10);
+    int levels = 0;
+    while (((size_t)JMP_IO_CHUNK << levels) < digits)
+        levels++;
+    mpz_t powers[JMP_IO_MAX_LEVELS];
+    if (levels > 0) {
+        mpz_init(powers[0]);
+        mpz_ui_pow_ui(powers[0], 10, JMP_IO_CHUNK);
+    }
+    for (int i = 1; i < levels; i++) {
+        mpz_init(powers[i]);
+        mpz_mul(powers[i], powers[i - 1], powers[i - 1]);
+    }
+    /* mpz_get_str wants mpz_sizeinbase + 2 bytes, and sizeinbase may be
+     * one more than the JMP_IO_CHUNK digits of a piece. */
+    char *scratch = janet_smalloc(JMP_IO_CHUNK + 3);
+    write_dec_rec(sink, x, levels, powers, 0, scratch);
+    janet_sfree(scratch);
+    for (int i = 0; i < levels; i++)
+        mpz_clear(powers[i]);
+}
+
+static void write_hex(JmpSink *sink, mpz_srcptr x) {
+    static const char digits[] = "0123456789abcdef";
+    size_t size = mpz_size(x);
+    if (size == 0) {
+        sink_write(sink, "0", 1);
+        return;
+    }
+    const mp_limb_t *limbs = mpz_limbs_read(x);
+    char chunk[JMP_IO_CHUNK];
+    size_t count = 0;
+    int leading = 1;
+    for (size_t i = size; i-- > 0;) {
+        mp_limb_t limb = limbs[i];
+        for (int shift = GMP_NUMB_BITS - 4; shift >= 0; shift -= 4) {
+            int digit = (int)((limb >> shift) & 0xf);
+            if (leading && digit == 0)
+                continue;
+            leading = 0;
+            chunk[count++] = digits[digit];
+        }
+        if (count > JMP_IO_CHUNK - GMP_NUMB_BITS / 4) {
+            sink_write(sink, chunk, count);
+            count = 0;
+        }
+    }
+    sink_write(sink, chunk, count);
+}
+
+static void write_bin(JmpSink *sink, mpz_srcptr x) {
+    size_t size = mpz_size(x);
+    const mp_limb_t *limbs = mpz_limbs_read(x);
+    char chunk[JMP_IO_CHUNK];
+    size_t count = 0;
+    int leading = 1;
+    for (size_t i = size; i-- > 0;) {
+        mp_limb_t limb = limbs[i];
+        for (int shift = GMP_NUMB_BITS - 8; shift >= 0; shift -= 8) {
+            char byte = (char)((limb >> shift) & 0xff);
+            if (leading && byte == 0)
+                continue;
+            leading = 0;
+            chunk[count++] = byte;
+        }
+        if (count > JMP_IO_CHUNK - GMP_NUMB_BITS / 8) {
+            sink_write(sink, chunk, count);
+            count = 0;
+        }
+    }
+    sink_write(sink, chunk, count);
+}
+
+JANET_FN(cfun_mpz_write,
+         "(jmp/write x dest &opt format)",
+         "Write x to dest, a core/file or a buffer, without building the whole "
+         "string representation in memory. format is :dec (default), :hex "
+         "or :bin for the raw big endian bytes of the absolute value. "
+         "Returns dest.") {
+    janet_arity(argc, 2, 3);
+    mpz_ptr x = (mpz_ptr)janet_getabstract(argv, 0, &jmp_mpz_type);
+    JmpFormat format = jmp_optformat(argv, argc, 2);
+    JmpSink sink = {NULL, NULL, 0};
+    if (janet_checktype(argv[1], JANET_BUFFER)) {
+        sink.buffer = janet_unwrap_buffer(argv[1]);
+    } else if (janet_checkfile(argv[1])) {
+        sink.file = jmp_checkopenfile(argv[1], JMP_FILE_WRITABLE);
+    } else {
+        janet_panicf("expected core/file or buffer, got %v", argv[1]);
+    }
+
+    /* A read only alias of the absolute value, the sign is written here. */
+    mpz_t abs;
+    mpz_roinit_n(abs, mpz_limbs_read(x), (mp_size_t)mpz_size(x));
+    switch (format) {
+        case JMP_FORMAT_DEC:
+            if (mpz_sgn(x) < 0) sink_write(&sink, "-", 1);
+            write_dec(&sink, abs);
+            break;
+        case JMP_FORMAT_HEX:
+            if (mpz_sgn(x) < 0) sink_write(&sink, "-", 1);
+            write_hex(&sink, abs);
+            break;
+        case JMP_FORMAT_BIN:
+            write_bin(&sink, abs);
+            break;
+    }
+    if (sink.failed)
+        janet_panic("could not write to file");
+    return argv[1];
+}
+
+/*********/
+/* Input */
+/*********/
+
+typedef struct {
+    FILE *file;
+    const uint8_t *bytes;
+    int32_t len;
+    int32_t pos;
+    size_t remaining;
+} JmpSource;
+
+static int source_getc(JmpSource *src) {
+    if (src->remaining == 0)
+        return EOF;
+    int c;
+    if (src->file) {
+        c = getc(src->file);
+    } else {
+        c = src->pos < src->len ? src->bytes[src->pos++] : EOF;
+    }
+    if (c != EOF)
+        src->remaining--;
+    return c;
+}
+
+static void source_ungetc(JmpSource *src, int c) {
+    if (c == EOF)
+        return;
+    if (src->file) {
+        ungetc(c, src->file);
+    } else {
+        src->pos--;
+    }
+    src->remaining++;
+}
+
+typedef struct {
+    mpz_t value;
+    size_t digits;
+} JmpPiece;
+
+/* Multiply hi by base^digits and add lo. Chunk powers of ten are cached
+ * by level since the balanced merges ask for the same ones repeatedly. */
+static void combine(mpz_ptr hi, mpz_srcptr lo, size_t digits, JmpFormat format,
+                    mpz_t *powers, int *npowers) {
+    switch (format) {
+        case JMP_FORMAT_HEX:
+            mpz_mul_2exp(hi, hi, 4 * digits);
+            break;
+        case JMP_FORMAT_BIN:
+            mpz_mul_2exp(hi, hi, 8 * digits);
+            break;
+        case JMP_FORMAT_DEC: {
+            int level = -1;
+            for (int i = 0; i < JMP_IO_MAX_LEVELS && ((size_t)JMP_IO_CHUNK << i) <= digits; i++) {
+                if (((size_t)JMP_IO_CHUNK << i) == digits) {
+                    level = i;
+                    break;
+                }
+            }
+            if (level >= 0) {
+                while (*npowers <= level) {
+                    mpz_init(powers[*npowers]);
+                    if (*npowers == 0)
+                        mpz_ui_pow_ui(powers[0], 10, JMP_IO_CHUNK);
+                    else
+                        mpz_mul(powers[*npowers], powers[*npowers - 1], powers[*npowers - 1]);
+                    (*npowers)++;
+                }
+                mpz_mul(hi, hi, powers[level]);
+            } else {
+                mpz_t power;
+                mpz_init(power);
+                mpz_ui_pow_ui(power, 10, digits);
+                mpz_mul(hi, hi, power);
+                mpz_clear(power);
+            }
+            break;
+        }
+    }
+    mpz_add(hi, hi, lo);
+}
+
+static int is_format_digit(int c, JmpFormat format) {
+    switch (format) {
+        case JMP_FORMAT_DEC: return c != EOF && isdigit(c);
+        case JMP_FORMAT_HEX: return c != EOF && isxdigit(c);
+        case JMP_FORMAT_BIN: return c != EOF;
+    }
+    return 0;
+}
+
+JANET_FN(cfun_mpz_read,
+         "(jmp/read src &opt format limit)",
+         "Read an integer from src, a core/file, buffer or string, in chunks. "
+         "format is :dec (default), :hex or :bin for raw big endian bytes. "
+         "For :dec and :hex leading whitespace and a minus sign are accepted "
+         "and reading stops before the first character that is not a digit, "
+         "so a file can hold several numbers. :bin reads until the end of the "
+         "input. At most limit bytes are consumed. The chunks are combined in "
+         "a balanced tree, which keeps the conversion subquadratic.") {
+    janet_arity(argc, 1, 3);
+    JmpFormat format = jmp_optformat(argv, argc, 1);
+    JmpSource src = {NULL, NULL, 0, 0, SIZE_MAX};
+    if (argc > 2 && !janet_checktype(argv[2], JANET_NIL))
+        src.remaining = janet_getsize(argv, 2);
+    if (janet_checkfile(argv[0])) {
+        src.file = jmp_checkopenfile(argv[0], JMP_FILE_READABLE);
+    } else if (!janet_bytes_view(argv[0], &src.bytes, &src.len)) {
+        janet_panicf("expected core/file or bytes, got %v", argv[0]);
+    }
+
+    int negative = 0;
+    int c = source_getc(&src);
+    if (format != JMP_FORMAT_BIN) {
+        while (c != EOF && isspace(c))
+            c = source_getc(&src);
+        if (c == '-') {
+            negative = 1;
+            c = source_getc(&src);
+        }
+    }
+    if (format != JMP_FORMAT_BIN && !is_format_digit(c, format)) {
+        source_ungetc(&src, c);
+        janet_panic("expected digits");
+    }
+
+    JmpPiece stack[JMP_IO_MAX_LEVELS + 1];
+    int depth = 0;
+    mpz_t powers[JMP_IO_MAX_LEVELS];
+    int npowers = 0;
+    char *chunk = janet_smalloc(JMP_IO_CHUNK + 1);
+    while (is_format_digit(c, format)) {
+        size_t count = 0;
+        while (count < JMP_IO_CHUNK && is_format_digit(c, format)) {
+            chunk[count++] = (char)c;
+            c = source_getc(&src);
+        }
+        JmpPiece *piece = &stack[depth++];
+        piece->digits = count;
+        if (format == JMP_FORMAT_BIN) {
+            mpz_init(piece->value);
+            mpz_import(piece->value, count, 1, 1, 0, 0, chunk);
+        } else {
+            chunk[count] = '\0';
+            mpz_init_set_str(piece->value, chunk, format == JMP_FORMAT_HEX ? 16 : 10);
+        }
+        /* Merge equally sized neighbours like a binary counter. */
+        while (depth > 1 && stack[depth - 2].digits == stack[depth - 1].digits) {
+            JmpPiece *hi = &stack[depth - 2];
+            JmpPiece *lo = &stack[depth - 1];
+            combine(hi->value, lo->value, lo->digits, format, powers, &npowers);
+            hi->digits += lo->digits;
+            mpz_clear(lo->value);
+            depth--;
+        }
+    }
+    source_ungetc(&src, c);
+    janet_sfree(chunk);
+
+    /* Fold the remaining, strictly decreasing, pieces from the right. */
+    while (depth > 1) {
+        JmpPiece *hi = &stack[depth - 2];
+        JmpPiece *lo = &stack[depth - 1];
+        combine(hi->value, lo->value, lo->digits, format, powers, &npowers);
+        hi->digits += lo->digits;
+        mpz_clear(lo->value);
+        depth--;
+    }
+    for (int i = 0; i < npowers; i++)
+        mpz_clear(powers[i]);
+
+    /* Empty raw input is zero, like in jmp/import-str. */
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    if (depth > 0) {
+        mpz_swap(box, stack[0].value);
+        mpz_clear(stack[0].value);
+    }
+    if (negative)
+        mpz_neg(box, box);
+    return janet_wrap_abstract(box);
+}
+
+void jmp_lib_io(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("write", cfun_mpz_write),
+        JANET_REG("read", cfun_mpz_read),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+}
@@ -0,0 +1,68 @@
+#ifndef JMP_H
+#define JMP_H
+
+#include <gmp.h>
+#include <janet.h>
+
+/* mpz.c */
+extern const JanetAbstractType jmp_mpz_type;
+void janet_unwrap_mpz(Janet x, mpz_ptr mpz);
+
+/* A read only jmp/mpz whose limbs are owned by another janet value. Views
+ * are jmp/mpz boxes of this larger size, so every function that only reads
+ * its arguments accepts them. */
+typedef struct {
+    mpz_t value;
+    Janet owner;
+} JmpMpzView;
+
+Janet jmp_wrap_view(Janet owner, const mp_limb_t *limbs, mp_size_t size);
+int jmp_mpz_is_view(mpz_srcptr x);
+
+/* parallel.c */
+
+/* Workers only touch GMP objects no other thread uses and never call into
+ * janet, so they can not panic. */
+#define JMP_MAX_THREADS 16
+typedef void (*JmpRangeFn)(void *ctx, int32_t lo, int32_t hi);
+
+int jmp_default_threads(void);
+int jmp_optthreads(const Janet *argv, int32_t argc, int32_t n, int parallel);
+void jmp_parallel_for(int32_t lo, int32_t hi, int threads, JmpRangeFn fn, void *ctx);
+
+/* rand.c */
+extern const JanetAbstractType jmp_randstate_type;
+void jmp_lib_rand(JanetTable *env);
+
+/* io.c */
+void jmp_lib_io(JanetTable *env);
+
+/* mmap.c */
+extern const JanetAbstractType jmp_mmap_type;
+void jmp_lib_mmap(JanetTable *env);
+
+/* mpzvec.c */
+extern const JanetAbstractType jmp_mpzvec_type;
+void jmp_lib_mpzvec(JanetTable *env);
+
+/* sort.c */
+void jmp_lib_sort(JanetTable *env);
+
+/* poly.c */
+extern const JanetAbstractType jmp_poly_type;
+void jmp_lib_poly(JanetTable *env);
+
+/* mat.c */
+extern const JanetAbstractType jmp_mat_type;
+void jmp_lib_mat(JanetTable *env);
+
+/* rns.c */
+extern const JanetAbstractType jmp_rns_basis_type;
+extern const JanetAbstractType jmp_rns_type;
+void jmp_lib_rns(JanetTable *env);
+
+/* decimal.c */
+extern const JanetAbstractType jmp_decimal_type;
+void jmp_lib_decimal(JanetTable *env);
+
+#endif
@@ -0,0 +1,530 @@
+#include "jmp.h"
+
+/* Work, in entries times rows, above which the kernels use threads when
+ * the caller does not ask for a number. */
+#define JMP_MAT_PARALLEL 65536
+
+/* Dense matrix with rows * cols entries stored row-major in one array. */
+typedef struct {
+    int32_t rows;
+    int32_t cols;
+    mpz_t *data;
+} JmpMat;
+
+#define MAT_AT(m, i, j) ((m)->data[(size_t)(i) * (m)->cols + (j)])
+
+static Janet cfun_mat_add(int32_t argc, Janet *argv);
+static Janet cfun_mat_sub(int32_t argc, Janet *argv);
+static Janet cfun_mat_mul_method(int32_t argc, Janet *argv);
+
+static int mat_gc(void *data, size_t len)
+{
+    (void) len;
+    JmpMat *mat = (JmpMat *)data;
+    if (mat->data) {
+        size_t n = (size_t)mat->rows * mat->cols;
+        for (size_t i = 0; i < n; i++)
+            mpz_clear(mat->data[i]);
+        janet_free(mat->data);
+    }
+    return 0;
+}
+
+static JanetMethod mat_methods[] = {
+    {"+", cfun_mat_add},
+    {"-", cfun_mat_sub},
+    {"*", cfun_mat_mul_method},
+    {"r*", cfun_mat_mul_method},
+    {NULL, NULL}
+};
+
+static int mat_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), mat_methods, out);
+}
+
+static Janet mat_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(mat_methods, key);
+}
+
+static void mat_tostring(void *p, JanetBuffer *buffer) {
+    JmpMat *mat = (JmpMat *)p;
+    janet_buffer_push_cstring(buffer, "[");
+    for (int32_t i = 0; i < mat->rows; i++) {
+        janet_buffer_push_cstring(buffer, i ? " [" : "[");
+        for (int32_t j = 0; j < mat->cols; j++) {
+            mpz_srcptr x = MAT_AT(mat, i, j);
+            char *str = janet_smalloc(mpz_sizeinbase(x, 10) + 2);
+            mpz_get_str(str, 10, x);
+            if (j) janet_buffer_push_cstring(buffer, " ");
+            janet_buffer_push_cstring(buffer, str);
+            janet_sfree(str);
+        }
+        janet_buffer_push_cstring(buffer, "]");
+    }
+    janet_buffer_push_cstring(buffer, "]");
+}
+
+static int mat_compare(void *p1, void *p2) {
+    JmpMat *a = (JmpMat *)p1;
+    JmpMat *b = (JmpMat *)p2;
+    if (a->rows != b->rows)
+        return a->rows < b->rows ? -1 : 1;
+    if (a->cols != b->cols)
+        return a->cols < b->cols ? -1 : 1;
+    size_t n = (size_t)a->rows * a->cols;
+    for (size_t i = 0; i < n; i++) {
+        int c = mpz_cmp(a->data[i], b->data[i]);
+        if (c != 0)
+            return c;
+    }
+    return 0;
+}
+
+const JanetAbstractType jmp_mat_type = {
+    "jmp/mat",
+    mat_gc,
+    NULL,
+    mat_get,
+    NULL,
+    NULL,
+    NULL,
+    mat_tostring,
+    mat_compare,
+    NULL,
+    mat_next,
+    JANET_ATEND_NEXT
+};
+
+/* A zero matrix. */
+static JmpMat *mat_new(int32_t rows, int32_t cols) {
+    if (rows < 0 || cols < 0 || (cols > 0 && rows > INT32_MAX / cols))
+        janet_panicf("invalid matrix size %d x %d", rows, cols);
+    JmpMat *mat = janet_abstract(&jmp_mat_type, sizeof(JmpMat));
+    mat->rows = 0;
+    mat->cols = 0;
+    mat->data = NULL;
+    size_t n = (size_t)rows * cols;
+    if (n > 0) {
+        mat->data = janet_malloc(n * sizeof(mpz_t));
+        if (!mat->data) janet_panic("out of memory");
+        for (size_t i = 0; i < n; i++)
+            mpz_init(mat->data[i]);
+    }
+    mat->rows = rows;
+    mat->cols = cols;
+    return mat;
+}
+
+static JmpMat *mat_copy(const JmpMat *src) {
+    JmpMat *mat = mat_new(src->rows, src->cols);
+    size_t n = (size_t)src->rows * src->cols;
+    for (size_t i = 0; i < n; i++)
+        mpz_set(mat->data[i], src->data[i]);
+    return mat;
+}
+
+static void mat_swap_rows(JmpMat *mat, int32_t a, int32_t b) {
+    for (int32_t j = 0; j < mat->cols; j++)
+        mpz_swap(MAT_AT(mat, a, j), MAT_AT(mat, b, j));
+}
+
+static int mat_threads(const Janet *argv, int32_t argc, int32_t n, double work) {
+    return jmp_optthreads(argv, argc, n, work >= JMP_MAT_PARALLEL);
+}
+
+/***************/
+/* Multiplying */
+/***************/
+
+typedef struct {
+    JmpMat *c;
+    const JmpMat *a;
+    const JmpMat *b;
+} JmpMulCtx;
+
+/* Rows lo to hi of c += a * b, accumulating in place with mpz_addmul. */
+static void mul_rows(void *p, int32_t lo, int32_t hi) {
+    JmpMulCtx *ctx = (JmpMulCtx *)p;
+    for (int32_t i = lo; i < hi; i++) {
+        for (int32_t k = 0; k < ctx->a->cols; k++) {
+            mpz_srcptr x = MAT_AT(ctx->a, i, k);
+            if (mpz_sgn(x) == 0)
+                continue;
+            for (int32_t j = 0; j < ctx->b->cols; j++)
+                mpz_addmul(MAT_AT(ctx->c, i, j), x, MAT_AT(ctx->b, k, j));
+        }
+    }
+}
+
+static JmpMat *mat_mul(const JmpMat *a, const JmpMat *b, int threads) {
+    if (a->cols != b->rows)
+        janet_panicf("can not multiply %d x %d and %d x %d matrices",
+                     a->rows, a->cols, b->rows, b->cols);
+    JmpMat *c = mat_new(a->rows, b->cols);
+    JmpMulCtx ctx = {c, a, b};
+    jmp_parallel_for(0, a->rows, threads, mul_rows, &ctx);
+    return c;
+}
+
+/************/
+/* Bareiss  */
+/************/
+
+typedef struct {
+    JmpMat *m;
+    int32_t row;
+    int32_t col;
+    mpz_srcptr prev;
+} JmpBareissCtx;
+
+/* One fraction-free elimination step below the pivot at (row, col):
+ * m[i][j] = (pivot * m[i][j] - m[i][col] * m[row][j]) / prev, exact. */
+static void bareiss_rows(void *p, int32_t lo, int32_t hi) {
+    JmpBareissCtx *ctx = (JmpBareissCtx *)p;
+    JmpMat *m = ctx->m;
+    mpz_srcptr pivot = MAT_AT(m, ctx->row, ctx->col);
+    mpz_t tmp;
+    mpz_init(tmp);
+    for (int32_t i = lo; i < hi; i++) {
+        mpz_ptr factor = MAT_AT(m, i, ctx->col);
+        for (int32_t j = ctx->col + 1; j < m->cols; j++) {
+            mpz_mul(tmp, pivot, MAT_AT(m, i, j));
+            mpz_submul(tmp, factor, MAT_AT(m, ctx->row, j));
+            mpz_divexact(MAT_AT(m, i, j), tmp, ctx->prev);
+        }
+        mpz_set_ui(factor, 0);
+    }
+    mpz_clear(tmp);
+}
+
+/* Bring m into fraction-free row echelon form in place. Only the first
+ * ncols columns are used for pivots. Returns the rank and sets *sign to
+ * the sign of the row permutation. */
+static int32_t bareiss(JmpMat *m, int32_t ncols, int threads, int *sign) {
+    mpz_t prev;
+    mpz_init_set_ui(prev, 1);
+    int32_t row = 0;
+    *sign = 1;
+    for (int32_t col = 0; col < ncols && row < m->rows; col++) {
+        int32_t pivot = row;
+        while (pivot < m->rows && mpz_sgn(MAT_AT(m, pivot, col)) == 0)
+            pivot++;
+        if (pivot == m->rows)
+            continue;
+        if (pivot != row) {
+            mat_swap_rows(m, pivot, row);
+            *sign = -*sign;
+        }
+        JmpBareissCtx ctx = {m, row, col, prev};
+        jmp_parallel_for(row + 1, m->rows, threads, bareiss_rows, &ctx);
+        mpz_set(prev, MAT_AT(m, row, col));
+        row++;
+    }
+    mpz_clear(prev);
+    return row;
+}
+
+/* Solve a x = d b for square a by elimination on [a | b], setting det to
+ * d = |det a|. Panics if a is singular. */
+static JmpMat *mat_solve(const JmpMat *a, const JmpMat *b, int threads, mpz_ptr det) {
+    int32_t n = a->rows;
+    JmpMat *m = mat_new(n, n + b->cols);
+    for (int32_t i = 0; i < n; i++) {
+        for (int32_t j = 0; j < n; j++)
+            mpz_set(MAT_AT(m, i, j), MAT_AT(a, i, j));
+        for (int32_t j = 0; j < b->cols; j++)
+            mpz_set(MAT_AT(m, i, n + j), MAT_AT(b, i, j));
+    }
+    int sign;
+    if (bareiss(m, n, threads, &sign) < n)
+        janet_panic("matrix is singular");
+
+    /* With d the last pivot, back substitution
+     * x_i = (d * m[i][rhs] - sum m[i][j] x_j) / m[i][i] stays exact, these
+     * are the numerators of Cramer's rule. */
+    mpz_srcptr d = MAT_AT(m, n - 1, n - 1);
+    JmpMat *x = mat_new(n, b->cols);
+    mpz_t acc;
+    mpz_init(acc);
+    for (int32_t c = 0; c < b->cols; c++) {
+        for (int32_t i = n - 1; i >= 0; i--) {
+            mpz_mul(acc, d, MAT_AT(m, i, n + c));
+            for (int32_t j = i + 1; j < n; j++)
+                mpz_submul(acc, MAT_AT(m, i, j), MAT_AT(x, j, c));
+            mpz_divexact(MAT_AT(x, i, c), acc, MAT_AT(m, i, i));
+        }
+    }
+    mpz_clear(acc);
+    mpz_set(det, d);
+    if (mpz_sgn(det) < 0) {
+        mpz_neg(det, det);
+        size_t count = (size_t)n * b->cols;
+        for (size_t i = 0; i < count; i++)
+            mpz_neg(x->data[i], x->data[i]);
+    }
+    return x;
+}
+
+/***********/
+/* Methods */
+/***********/
+
+static JmpMat *mat_add_sub(const JmpMat *a, const JmpMat *b, int subtract) {
+    if (a->rows != b->rows || a->cols != b->cols)
+        janet_panicf("can not add %d x %d and %d x %d matrices",
+                     a->rows, a->cols, b->rows, b->cols);
+    JmpMat *c = mat_new(a->rows, a->cols);
+    size_t n = (size_t)a->rows * a->cols;
+    for (size_t i = 0; i < n; i++) {
+        if (subtract)
+            mpz_sub(c->data[i], a->data[i], b->data[i]);
+        else
+            mpz_add(c->data[i], a->data[i], b->data[i]);
+    }
+    return c;
+}
+
+static Janet cfun_mat_add(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpMat *a = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *b = janet_getabstract(argv, 1, &jmp_mat_type);
+    return janet_wrap_abstract(mat_add_sub(a, b, 0));
+}
+
+static Janet cfun_mat_sub(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpMat *a = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *b = janet_getabstract(argv, 1, &jmp_mat_type);
+    return janet_wrap_abstract(mat_add_sub(a, b, 1));
+}
+
+static Janet cfun_mat_mul_method(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpMat *a = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *b = janet_checkabstract(argv[1], &jmp_mat_type);
+    if (b) {
+        double work = (double)a->rows * a->cols * b->cols;
+        return janet_wrap_abstract(mat_mul(a, b, mat_threads(argv, 0, 0, work)));
+    }
+    mpz_t scalar;
+    janet_unwrap_mpz(argv[1], scalar);
+    JmpMat *c = mat_new(a->rows, a->cols);
+    size_t n = (size_t)a->rows * a->cols;
+    for (size_t i = 0; i < n; i++)
+        mpz_mul(c->data[i], a->data[i], scalar);
+    mpz_clear(scalar);
+    return janet_wrap_abstract(c);
+}
+
+JANET_FN(cfun_mat_new,
+         "(jmp/mat rows)",
+         "Create a matrix from an indexed collection of equally long rows of "
+         "integers. Supports + and - with matrices and * with matrices and "
+         "integers.") {
+    janet_fixarity(argc, 1);
+    JanetView rows = janet_getindexed(argv, 0);
+    int32_t cols = 0;
+    for (int32_t i = 0; i < rows.len; i++) {
+        const Janet *items;
+        int32_t len;
+        if (!janet_indexed_view(rows.items[i], &items, &len))
+            janet_panicf("expected indexed row, got %v", rows.items[i]);
+        if (i == 0)
+            cols = len;
+        else if (len != cols)
+            janet_panicf("row %d has %d entries, expected %d", i, len, cols);
+    }
+    JmpMat *mat = mat_new(rows.len, cols);
+    for (int32_t i = 0; i < rows.len; i++) {
+        const Janet *items;
+        int32_t len;
+        janet_indexed_view(rows.items[i], &items, &len);
+        for (int32_t j = 0; j < cols; j++) {
+            mpz_t x;
+            janet_unwrap_mpz(items[j], x);
+            mpz_swap(MAT_AT(mat, i, j), x);
+            mpz_clear(x);
+        }
+    }
+    return janet_wrap_abstract(mat);
+}
+
+JANET_FN(cfun_mat_zero,
+         "(jmp/mat-zero rows cols)",
+         "Create a rows x cols zero matrix.") {
+    janet_fixarity(argc, 2);
+    return janet_wrap_abstract(mat_new(janet_getnat(argv, 0), janet_getnat(argv, 1)));
+}
+
+JANET_FN(cfun_mat_identity,
+         "(jmp/mat-identity n)",
+         "Create an n x n identity matrix.") {
+    janet_fixarity(argc, 1);
+    int32_t n = janet_getnat(argv, 0);
+    JmpMat *mat = mat_new(n, n);
+    for (int32_t i = 0; i < n; i++)
+        mpz_set_ui(MAT_AT(mat, i, i), 1);
+    return janet_wrap_abstract(mat);
+}
+
+JANET_FN(cfun_mat_size,
+         "(jmp/mat-size m)",
+         "Number of rows and columns of m as a tuple [rows cols].") {
+    janet_fixarity(argc, 1);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_wrap_integer(mat->rows);
+    tup[1] = janet_wrap_integer(mat->cols);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+static void mat_getindex(const JmpMat *mat, const Janet *argv, int32_t *i, int32_t *j) {
+    *i = janet_getinteger(argv, 1);
+    *j = janet_getinteger(argv, 2);
+    if (*i < 0 || *i >= mat->rows || *j < 0 || *j >= mat->cols)
+        janet_panicf("index (%d, %d) out of range for %d x %d matrix", *i, *j, mat->rows, mat->cols);
+}
+
+JANET_FN(cfun_mat_get,
+         "(jmp/mat-get m i j)",
+         "Entry in row i and column j of m.") {
+    janet_fixarity(argc, 3);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    int32_t i, j;
+    mat_getindex(mat, argv, &i, &j);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init_set(box, MAT_AT(mat, i, j));
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mat_set,
+         "(jmp/mat-set m i j x)",
+         "Set the entry in row i and column j of m to x. Returns m.") {
+    janet_fixarity(argc, 4);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    int32_t i, j;
+    mat_getindex(mat, argv, &i, &j);
+    mpz_t x;
+    janet_unwrap_mpz(argv[3], x);
+    mpz_swap(MAT_AT(mat, i, j), x);
+    mpz_clear(x);
+    return argv[0];
+}
+
+JANET_FN(cfun_mat_to_array,
+         "(jmp/mat->array m)",
+         "Array of rows, each an array of jmp/mpz.") {
+    janet_fixarity(argc, 1);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    JanetArray *rows = janet_array(mat->rows);
+    for (int32_t i = 0; i < mat->rows; i++) {
+        JanetArray *row = janet_array(mat->cols);
+        for (int32_t j = 0; j < mat->cols; j++) {
+            mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+            mpz_init_set(box, MAT_AT(mat, i, j));
+            row->data[j] = janet_wrap_abstract(box);
+        }
+        row->count = mat->cols;
+        rows->data[i] = janet_wrap_array(row);
+    }
+    rows->count = mat->rows;
+    return janet_wrap_array(rows);
+}
+
+JANET_FN(cfun_mat_mul,
+         "(jmp/mat-mul a b &opt threads)",
+         "Matrix product of a and b. Large products are split by rows over "
+         "several threads, threads overrides their number.") {
+    janet_arity(argc, 2, 3);
+    JmpMat *a = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *b = janet_getabstract(argv, 1, &jmp_mat_type);
+    double work = (double)a->rows * a->cols * b->cols;
+    return janet_wrap_abstract(mat_mul(a, b, mat_threads(argv, argc, 2, work)));
+}
+
+JANET_FN(cfun_mat_det,
+         "(jmp/mat-det m &opt threads)",
+         "Determinant of the square matrix m by Bareiss' fraction-free "
+         "elimination.") {
+    janet_arity(argc, 1, 2);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    if (mat->rows != mat->cols)
+        janet_panicf("expected square matrix, got %d x %d", mat->rows, mat->cols);
+    JmpMat *m = mat_copy(mat);
+    double work = (double)m->rows * m->rows * m->rows;
+    int sign;
+    int32_t rank = bareiss(m, m->cols, mat_threads(argv, argc, 1, work), &sign);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    if (m->rows == 0)
+        mpz_set_ui(box, 1);
+    else if (rank == m->rows)
+        mpz_mul_si(box, MAT_AT(m, m->rows - 1, m->cols - 1), sign);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mat_echelon,
+         "(jmp/mat-echelon m &opt threads)",
+         "Fraction-free row echelon form of m by Bareiss' algorithm, as a "
+         "tuple [e rank]. All entries stay integers and are minors of m.") {
+    janet_arity(argc, 1, 2);
+    JmpMat *mat = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *m = mat_copy(mat);
+    double work = (double)m->rows * m->rows * m->cols;
+    int sign;
+    int32_t rank = bareiss(m, m->cols, mat_threads(argv, argc, 1, work), &sign);
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_wrap_abstract(m);
+    tup[1] = janet_wrap_integer(rank);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+JANET_FN(cfun_mat_solve,
+         "(jmp/mat-solve a b &opt threads)",
+         "Solve a x = b for a non-singular square matrix a and a matrix b "
+         "without leaving the integers. Returns a tuple [x d] with a positive "
+         "integer d, the absolute value of the determinant of a, such that "
+         "a x = d b. Divide by d to get the rational solution.") {
+    janet_arity(argc, 2, 3);
+    JmpMat *a = janet_getabstract(argv, 0, &jmp_mat_type);
+    JmpMat *b = janet_getabstract(argv, 1, &jmp_mat_type);
+    if (a->rows != a->cols)
+        janet_panicf("expected square matrix, got %d x %d", a->rows, a->cols);
+    if (b->rows != a->rows)
+        janet_panicf("right hand side has %d rows, expected %d", b->rows, a->rows);
+    int32_t n = a->rows;
+    if (n == 0)
+        janet_panic("expected non-empty matrix");
+
+    double work = (double)n * n * (n + b->cols);
+    mpz_ptr det = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(det);
+    JmpMat *x = mat_solve(a, b, mat_threads(argv, argc, 2, work), det);
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_wrap_abstract(x);
+    tup[1] = janet_wrap_abstract(det);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+void jmp_lib_mat(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("mat", cfun_mat_new),
+        JANET_REG("mat-zero", cfun_mat_zero),
+        JANET_REG("mat-identity", cfun_mat_identity),
+        JANET_REG("mat-size", cfun_mat_size),
+        JANET_REG("mat-get", cfun_mat_get),
+        JANET_REG("mat-set", cfun_mat_set),
+        JANET_REG("mat->array", cfun_mat_to_array),
+        JANET_REG("mat-mul", cfun_mat_mul),
+        JANET_REG("mat-det", cfun_mat_det),
+        JANET_REG("mat-echelon", cfun_mat_echelon),
+        JANET_REG("mat-solve", cfun_mat_solve),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_mat_type);
+}
@@ -0,0 +1,233 @@
+#include "jmp.h"
+
+/* Memory mapping is only implemented for POSIX systems. */
+#ifndef _WIN32
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* File layout, all fields in native byte order:
+ *
+ *   header    JmpMmapHeader
+ *   entries   count x JmpMmapEntry
+ *   limbs     packed limb data, offsets in entries are in limbs from here
+ *
+ * The header and entries are multiples of eight bytes, so the limbs of a
+ * page aligned mapping are properly aligned. */
+
+#define JMP_MMAP_MAGIC "JMPZ"
+#define JMP_MMAP_VERSION 1
+#define JMP_MMAP_ENDIAN 0x01020304
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t limb_bytes;
+    uint32_t endian;
+    uint64_t count;
+} JmpMmapHeader;
+
+typedef struct {
+    uint64_t offset;
+    int64_t size;
+} JmpMmapEntry;
+
+typedef struct {
+    void *base;
+    size_t length;
+    uint64_t count;
+    const JmpMmapEntry *entries;
+    const mp_limb_t *limbs;
+    uint64_t nlimbs;
+} JmpMmap;
+
+static int mmap_gc(void *data, size_t len)
+{
+    (void) len;
+    JmpMmap *map = (JmpMmap *)data;
+    if (map->base)
+        munmap(map->base, map->length);
+    map->base = NULL;
+    return 0;
+}
+
+static int mmap_get(void *p, Janet key, Janet *out) {
+    JmpMmap *map = (JmpMmap *)p;
+    if (!janet_checkint(key))
+        return 0;
+    int32_t index = janet_unwrap_integer(key);
+    if (index < 0 || (uint64_t)index >= map->count)
+        return 0;
+    const JmpMmapEntry *entry = &map->entries[index];
+    uint64_t size = entry->size < 0 ? -(uint64_t)entry->size : (uint64_t)entry->size;
+    if (entry->offset > map->nlimbs || size > map->nlimbs - entry->offset)
+        janet_panicf("corrupt entry %d in jmp/mmap", index);
+    *out = jmp_wrap_view(janet_wrap_abstract(map), map->limbs + entry->offset,
+                         (mp_size_t)entry->size);
+    return 1;
+}
+
+static Janet mmap_next(void *p, Janet key) {
+    JmpMmap *map = (JmpMmap *)p;
+    if (janet_checktype(key, JANET_NIL))
+        return map->count > 0 ? janet_wrap_integer(0) : janet_wrap_nil();
+    if (!janet_checkint(key))
+        return janet_wrap_nil();
+    int32_t index = janet_unwrap_integer(key) + 1;
+    if (index < 0 || (uint64_t)index >= map->count)
+        return janet_wrap_nil();
+    return janet_wrap_integer(index);
+}
+
+static size_t mmap_length(void *p, size_t len) {
+    (void) len;
+    return (size_t)((JmpMmap *)p)->count;
+}
+
+const JanetAbstractType jmp_mmap_type = {
+    "jmp/mmap",
+    mmap_gc,
+    NULL,
+    mmap_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    mmap_next,
+    NULL,
+    mmap_length,
+    JANET_ATEND_LENGTH
+};
+
+JANET_FN(cfun_mmap_write,
+         "(jmp/mmap-write path values)",
+         "Write an indexed collection of integers to the file at path in the "
+         "binary format read by jmp/mmap. The file is only readable on "
+         "machines with the same byte order and limb size.") {
+    janet_fixarity(argc, 2);
+    const char *path = janet_getcstring(argv, 0);
+    JanetView values = janet_getindexed(argv, 1);
+
+    /* Values that are not jmp/mpz are converted up front. */
+    mpz_ptr converted = janet_smalloc(sizeof(mpz_t) * (values.len > 0 ? values.len : 1));
+    mpz_srcptr *items = janet_smalloc(sizeof(mpz_srcptr) * (values.len > 0 ? values.len : 1));
+    int32_t nconverted = 0;
+    for (int32_t i = 0; i < values.len; i++) {
+        void *abst = janet_checkabstract(values.items[i], &jmp_mpz_type);
+        if (abst) {
+            items[i] = (mpz_srcptr)abst;
+        } else {
+            janet_unwrap_mpz(values.items[i], &converted[nconverted]);
+            items[i] = &converted[nconverted++];
+        }
+    }
+
+    JmpMmapHeader header;
+    memcpy(header.magic, JMP_MMAP_MAGIC, 4);
+    header.version = JMP_MMAP_VERSION;
+    header.limb_bytes = sizeof(mp_limb_t);
+    header.endian = JMP_MMAP_ENDIAN;
+    header.count = (uint64_t)values.len;
+
+    int ok = 0;
+    FILE *file = fopen(path, "wb");
+    if (file && fwrite(&header, sizeof(header), 1, file) == 1) {
+        ok = 1;
+        uint64_t offset = 0;
+        for (int32_t i = 0; ok && i < values.len; i++) {
+            JmpMmapEntry entry;
+            entry.offset = offset;
+            entry.size = mpz_sgn(items[i]) < 0 ? -(int64_t)mpz_size(items[i]) : (int64_t)mpz_size(items[i]);
+            offset += mpz_size(items[i]);
+            ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+        }
+        for (int32_t i = 0; ok && i < values.len; i++) {
+            size_t size = mpz_size(items[i]);
+            ok = fwrite(mpz_limbs_read(items[i]), sizeof(mp_limb_t), size, file) == size;
+        }
+    }
+    if (file && fclose(file) != 0)
+        ok = 0;
+
+    for (int32_t i = 0; i < nconverted; i++)
+        mpz_clear(&converted[i]);
+    janet_sfree(converted);
+    janet_sfree(items);
+    if (!ok)
+        janet_panicf("could not write %s", path);
+    return janet_wrap_nil();
+}
+
+JANET_FN(cfun_mmap_open,
+         "(jmp/mmap path)",
+         "Map a file written by jmp/mmap-write into memory. The result can be "
+         "indexed and iterated like an array and yields read only jmp/mpz "
+         "views of the mapped limbs, so pages are only loaded when a value is "
+         "used. The mapping stays alive as long as any view does.") {
+    janet_fixarity(argc, 1);
+    const char *path = janet_getcstring(argv, 0);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        janet_panicf("could not open %s", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        janet_panicf("could not stat %s", path);
+    }
+    size_t length = (size_t)st.st_size;
+    if (length < sizeof(JmpMmapHeader)) {
+        close(fd);
+        janet_panicf("%s is not a jmp/mmap file", path);
+    }
+    void *base = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        janet_panicf("could not map %s", path);
+
+    const JmpMmapHeader *header = (const JmpMmapHeader *)base;
+    const char *error = NULL;
+    if (memcmp(header->magic, JMP_MMAP_MAGIC, 4) != 0)
+        error = "%s is not a jmp/mmap file";
+    else if (header->version != JMP_MMAP_VERSION)
+        error = "%s has an unsupported version";
+    else if (header->limb_bytes != sizeof(mp_limb_t) || header->endian != JMP_MMAP_ENDIAN)
+        error = "%s was written on an incompatible machine";
+    else if (header->count > (length - sizeof(JmpMmapHeader)) / sizeof(JmpMmapEntry))
+        error = "%s is truncated";
+    if (error) {
+        munmap(base, length);
+        janet_panicf(error, path);
+    }
+
+    JmpMmap *map = janet_abstract(&jmp_mmap_type, sizeof(JmpMmap));
+    size_t data = sizeof(JmpMmapHeader) + header->count * sizeof(JmpMmapEntry);
+    map->base = base;
+    map->length = length;
+    map->count = header->count;
+    map->entries = (const JmpMmapEntry *)((const char *)base + sizeof(JmpMmapHeader));
+    map->limbs = (const mp_limb_t *)((const char *)base + data);
+    map->nlimbs = (length - data) / sizeof(mp_limb_t);
+    return janet_wrap_abstract(map);
+}
+
+void jmp_lib_mmap(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("mmap-write", cfun_mmap_write),
+        JANET_REG("mmap", cfun_mmap_open),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_mmap_type);
+}
+
+#else
+
+void jmp_lib_mmap(JanetTable *env) {
+    (void) env;
+}
+
+#endif
@@ -1,5 +1,4 @@
-#include <gmp.h>
-#include <janet.h>
+#include "jmp.h"
 
 static Janet cfun_mpz_compare(int32_t argc, Janet *argv);
 static Janet cfun_mpz_add(int32_t argc, Janet *argv);
@@ -19,7 +18,9 @@ static Janet cfun_mpz_not(int32_t argc, Janet *argv);
 
 static int mpz_gc(void *data, size_t len)
 {
-    (void) len;
+    /* Views do not own their limbs. */
+    if (len == sizeof(JmpMpzView))
+        return 0;
     mpz_ptr mpz = (mpz_ptr)data;
     mpz_clear(mpz);
     return 0;
@@ -27,8 +28,8 @@ static int mpz_gc(void *data, size_t len)
 
 static int mpz_gcmark(void *data, size_t len)
 {
-    (void) data;
-    (void) len;
+    if (len == sizeof(JmpMpzView))
+        janet_mark(((JmpMpzView *)data)->owner);
     return 0;
 }
 
@@ -132,6 +133,11 @@ void janet_unwrap_mpz(Janet x, mpz_ptr mpz) {
                 mpz_set_ui(mpz, *(uint64_t *)abst);
                 return;
             }
+            else if (janet_abstract_type(abst) == &jmp_mpz_type)
+            {
+                mpz_set(mpz, (mpz_ptr)abst);
+                return;
+            }
             break;
         }
     }
@@ -139,8 +145,77 @@ void janet_unwrap_mpz(Janet x, mpz_ptr mpz) {
     return;
 }
 
+Janet jmp_wrap_view(Janet owner, const mp_limb_t *limbs, mp_size_t size) {
+    JmpMpzView *view = janet_abstract(&jmp_mpz_type, sizeof(JmpMpzView));
+    mpz_roinit_n(view->value, limbs, size);
+    view->owner = owner;
+    return janet_wrap_abstract(view);
+}
+
+int jmp_mpz_is_view(mpz_srcptr x) {
+    return janet_abstract_size((void *)x) == sizeof(JmpMpzView);
+}
+
+/* GMP allocates limbs outside the Janet heap, so the collector only sees
+ * the small boxes. Growth is reported as memory pressure to pace
+ * collections by what bignums really hold. Allocations on worker threads
+ * land in their own, unused, VM state. */
+static void *(*gmp_alloc)(size_t);
+static void *(*gmp_realloc)(void *, size_t, size_t);
+static void (*gmp_free)(void *, size_t);
+
+static void *jmp_gmp_alloc(size_t size) {
+    janet_gcpressure(size);
+    return gmp_alloc(size);
+}
+
+static void *jmp_gmp_realloc(void *ptr, size_t old_size, size_t new_size) {
+    if (new_size > old_size)
+        janet_gcpressure(new_size - old_size);
+    return gmp_realloc(ptr, old_size, new_size);
+}
+
+static void jmp_track_memory(void) {
+    void *(*alloc)(size_t);
+    mp_get_memory_functions(&alloc, NULL, NULL);
+    if (alloc == jmp_gmp_alloc)
+        return;
+    mp_get_memory_functions(&gmp_alloc, &gmp_realloc, &gmp_free);
+    mp_set_memory_functions(jmp_gmp_alloc, jmp_gmp_realloc, gmp_free);
+}
+
+static mpz_ptr jmp_getmutable(const Janet *argv, int32_t n) {
+    mpz_ptr value = (mpz_ptr)janet_getabstract(argv, n, &jmp_mpz_type);
+    if (jmp_mpz_is_view(value))
+        janet_panic("cannot modify a read only jmp/mpz view");
+    return value;
+}
+
+/* With another jmp type on the right, Janet calls the mpz method of the
+ * left operand rather than the other type's reflected one. Hand the call
+ * on to that reflected method, as Janet does for a plain number on the
+ * left. Returns 0 if there is none. */
+static int jmp_reflect(int32_t argc, Janet *argv, const char *method, Janet *out) {
+    if (argc != 2 || !janet_checktype(argv[1], JANET_ABSTRACT))
+        return 0;
+    void *abst = janet_unwrap_abstract(argv[1]);
+    const JanetAbstractType *type = janet_abstract_type(abst);
+    if (type != &jmp_poly_type && type != &jmp_mat_type &&
+            type != &jmp_rns_type && type != &jmp_decimal_type)
+        return 0;
+    Janet fn;
+    if (!type->get(abst, janet_ckeywordv(method), &fn) || !janet_checktype(fn, JANET_CFUNCTION))
+        return 0;
+    Janet args[2] = {argv[1], argv[0]};
+    *out = janet_unwrap_cfunction(fn)(2, args);
+    return 1;
+}
+
 static Janet cfun_mpz_add(int32_t argc, Janet *argv) {
     janet_arity(argc, 2, -1);
+    Janet reflected;
+    if (jmp_reflect(argc, argv, "r+", &reflected))
+        return reflected;
     mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
     mpz_init_set(box, (mpz_ptr)janet_unwrap_abstract(argv[0]));
     for (int32_t i = 1; i < argc; i++) {
@@ -198,6 +273,9 @@ static Janet cfun_mpz_add(int32_t argc, Janet *argv) {
 
 static Janet cfun_mpz_sub(int32_t argc, Janet *argv) {
     janet_arity(argc, 2, -1);
+    Janet reflected;
+    if (jmp_reflect(argc, argv, "r-", &reflected))
+        return reflected;
     mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
     mpz_init_set(box, (mpz_ptr)janet_unwrap_abstract(argv[0]));
     for (int32_t i = 1; i < argc; i++) {
@@ -278,6 +356,9 @@ static Janet cfun_mpz_subi(int32_t argc, Janet *argv) {
 
 static Janet cfun_mpz_mul(int32_t argc, Janet *argv) {
     janet_arity(argc, 2, -1);
+    Janet reflected;
+    if (jmp_reflect(argc, argv, "r*", &reflected))
+        return reflected;
     mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
     mpz_init_set(box, (mpz_ptr)janet_unwrap_abstract(argv[0]));
     for (int32_t i = 1; i < argc; i++) {
@@ -331,6 +412,9 @@ static Janet cfun_mpz_mul(int32_t argc, Janet *argv) {
 
 static Janet cfun_mpz_div(int32_t argc, Janet *argv) {
     janet_arity(argc, 2, -1);
+    Janet reflected;
+    if (jmp_reflect(argc, argv, "r/", &reflected))
+        return reflected;
     mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
     mpz_init_set(box, (mpz_ptr)janet_unwrap_abstract(argv[0]));
     for (int32_t i = 1; i < argc; i++) {
@@ -811,11 +895,25 @@ fail:
 }
 
 JANET_FN(cfun_mpz_new,
-         "(jmp/mpz value)",
-         "Create a boxed integer from a string value.") {
-    janet_fixarity(argc, 1);
+         "(jmp/mpz value &opt bits)",
+         "Create a boxed integer from a string value. With bits, room for a "
+         "value of that many bits is allocated up front, which only helps "
+         "the in place bit operations jmp/setbit, jmp/clrbit and jmp/combit.") {
+    janet_arity(argc, 1, 2);
+    size_t bits = janet_optsize(argv, argc, 1, 0);
+    if (bits == 0) {
+        mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+        janet_unwrap_mpz(argv[0], box);
+        return janet_wrap_abstract(box);
+    }
+    /* Convert before allocating, so a panic never leaves the collector
+     * an uninitialized box. */
+    mpz_t value;
+    janet_unwrap_mpz(argv[0], value);
     mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
-    janet_unwrap_mpz(argv[0], box);
+    mpz_init2(box, bits);
+    mpz_set(box, value);
+    mpz_clear(value);
     return janet_wrap_abstract(box);
 }
 
@@ -823,7 +921,7 @@ JANET_FN(cfun_mpz_setbit,
          "(jmp/setbit value index)",
          "Set bit at index in value.") {
     janet_fixarity(argc, 2);
-    mpz_ptr value = (mpz_ptr)janet_getabstract(argv, 0, &jmp_mpz_type);
+    mpz_ptr value = jmp_getmutable(argv, 0);
     size_t index = janet_getsize(argv, 1);
     mpz_setbit(value, index);
     return janet_wrap_nil();
@@ -833,7 +931,7 @@ JANET_FN(cfun_mpz_clrbit,
          "(jmp/clrbit value index)",
          "Clear bit at index in value.") {
     janet_fixarity(argc, 2);
-    mpz_ptr value = (mpz_ptr)janet_getabstract(argv, 0, &jmp_mpz_type);
+    mpz_ptr value = jmp_getmutable(argv, 0);
     size_t index = janet_getsize(argv, 1);
     mpz_clrbit(value, index);
     return janet_wrap_nil();
@@ -843,7 +941,7 @@ JANET_FN(cfun_mpz_combit,
          "(jmp/combit value index)",
          "Complement bit at index in value.") {
     janet_fixarity(argc, 2);
-    mpz_ptr value = (mpz_ptr)janet_getabstract(argv, 0, &jmp_mpz_type);
+    mpz_ptr value = jmp_getmutable(argv, 0);
     size_t index = janet_getsize(argv, 1);
     mpz_combit(value, index);
     return janet_wrap_nil();
@@ -885,6 +983,148 @@ JANET_FN(cfun_mpz_export,
     return janet_wrap_string(str);
 }
 
+JANET_FN(cfun_mpz_pow,
+         "(jmp/pow x k)",
+         "Raise x to the non-negative integer power k.") {
+    janet_fixarity(argc, 2);
+    unsigned long k = janet_getsize(argv, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    janet_unwrap_mpz(argv[0], box);
+    mpz_pow_ui(box, box, k);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_sqrt,
+         "(jmp/sqrt x)",
+         "Truncated integer square root of x.") {
+    janet_fixarity(argc, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    janet_unwrap_mpz(argv[0], box);
+    if (mpz_sgn(box) < 0) janet_panic("square root of negative number");
+    mpz_sqrt(box, box);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_sqrtrem,
+         "(jmp/sqrtrem x)",
+         "Truncated integer square root s of x and remainder x-s^2 as a tuple [s r].") {
+    janet_fixarity(argc, 1);
+    mpz_ptr root = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    janet_unwrap_mpz(argv[0], root);
+    if (mpz_sgn(root) < 0) janet_panic("square root of negative number");
+    mpz_ptr rem = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(rem);
+    mpz_sqrtrem(root, rem, root);
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_wrap_abstract(root);
+    tup[1] = janet_wrap_abstract(rem);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+JANET_FN(cfun_mpz_root,
+         "(jmp/root x n)",
+         "Truncated integer n-th root of x.") {
+    janet_fixarity(argc, 2);
+    unsigned long n = janet_getsize(argv, 1);
+    if (n == 0) janet_panic("expected positive root");
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    janet_unwrap_mpz(argv[0], box);
+    if (mpz_sgn(box) < 0 && n % 2 == 0) janet_panic("even root of negative number");
+    mpz_root(box, box, n);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_perfect_square,
+         "(jmp/perfect-square? x)",
+         "Check if x is a perfect square.") {
+    janet_fixarity(argc, 1);
+    mpz_t x;
+    janet_unwrap_mpz(argv[0], x);
+    int result = mpz_perfect_square_p(x);
+    mpz_clear(x);
+    return janet_wrap_boolean(result);
+}
+
+JANET_FN(cfun_mpz_perfect_power,
+         "(jmp/perfect-power? x)",
+         "Check if x is a perfect power, that is if there are integers a and "
+         "b > 1 with x = a^b.") {
+    janet_fixarity(argc, 1);
+    mpz_t x;
+    janet_unwrap_mpz(argv[0], x);
+    int result = mpz_perfect_power_p(x);
+    mpz_clear(x);
+    return janet_wrap_boolean(result);
+}
+
+JANET_FN(cfun_mpz_factorial,
+         "(jmp/factorial n)",
+         "Factorial of n.") {
+    janet_fixarity(argc, 1);
+    unsigned long n = janet_getsize(argv, 0);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    mpz_fac_ui(box, n);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_binomial,
+         "(jmp/binomial n k)",
+         "Binomial coefficient n over k. n may be negative.") {
+    janet_fixarity(argc, 2);
+    unsigned long k = janet_getsize(argv, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    janet_unwrap_mpz(argv[0], box);
+    mpz_bin_ui(box, box, k);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_fib,
+         "(jmp/fib n)",
+         "The n-th Fibonacci number.") {
+    janet_fixarity(argc, 1);
+    unsigned long n = janet_getsize(argv, 0);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    mpz_fib_ui(box, n);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_reserve,
+         "(jmp/reserve value bits)",
+         "Grow the storage of value to hold at least bits bits, so later "
+         "jmp/setbit, jmp/clrbit and jmp/combit calls do not reallocate. "
+         "Arithmetic always returns a new value and does not benefit. Never "
+         "shrinks. Returns value.") {
+    janet_fixarity(argc, 2);
+    mpz_ptr value = jmp_getmutable(argv, 0);
+    size_t bits = janet_getsize(argv, 1);
+    if (bits > (size_t)value->_mp_alloc * GMP_NUMB_BITS)
+        mpz_realloc2(value, bits);
+    return argv[0];
+}
+
+JANET_FN(cfun_mpz_shrink,
+         "(jmp/shrink value)",
+         "Release storage of value beyond what its current value needs. "
+         "Returns value.") {
+    janet_fixarity(argc, 1);
+    mpz_ptr value = jmp_getmutable(argv, 0);
+    mpz_realloc2(value, mpz_sizeinbase(value, 2));
+    return argv[0];
+}
+
+JANET_FN(cfun_mpz_byte_size,
+         "(jmp/byte-size value)",
+         "Bytes of memory held by value, the box and its allocated limbs. "
+         "Read only views count only their box.") {
+    janet_fixarity(argc, 1);
+    mpz_ptr value = (mpz_ptr)janet_getabstract(argv, 0, &jmp_mpz_type);
+    if (jmp_mpz_is_view(value))
+        return janet_wrap_number((double)sizeof(JmpMpzView));
+    return janet_wrap_number((double)(sizeof(mpz_t) + (size_t)value->_mp_alloc * sizeof(mp_limb_t)));
+}
+
 /****************/
 /* Module Entry */
 /****************/
@@ -898,8 +1138,30 @@ JANET_MODULE_ENTRY(JanetTable *env) {
         JANET_REG("tstbit", cfun_mpz_tstbit),
         JANET_REG("import-str", cfun_mpz_import),
         JANET_REG("export-str", cfun_mpz_export),
+        JANET_REG("pow", cfun_mpz_pow),
+        JANET_REG("sqrt", cfun_mpz_sqrt),
+        JANET_REG("sqrtrem", cfun_mpz_sqrtrem),
+        JANET_REG("root", cfun_mpz_root),
+        JANET_REG("perfect-square?", cfun_mpz_perfect_square),
+        JANET_REG("perfect-power?", cfun_mpz_perfect_power),
+        JANET_REG("factorial", cfun_mpz_factorial),
+        JANET_REG("binomial", cfun_mpz_binomial),
+        JANET_REG("fib", cfun_mpz_fib),
+        JANET_REG("reserve", cfun_mpz_reserve),
+        JANET_REG("shrink", cfun_mpz_shrink),
+        JANET_REG("byte-size", cfun_mpz_byte_size),
         JANET_REG_END
     };
     janet_cfuns_ext(env, "jmp", cfuns);
     janet_register_abstract_type(&jmp_mpz_type);
+    jmp_track_memory();
+    jmp_lib_rand(env);
+    jmp_lib_io(env);
+    jmp_lib_mmap(env);
+    jmp_lib_mpzvec(env);
+    jmp_lib_sort(env);
+    jmp_lib_poly(env);
+    jmp_lib_mat(env);
+    jmp_lib_rns(env);
+    jmp_lib_decimal(env);
 }
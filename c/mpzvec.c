@@ -0,0 +1,403 @@
+#include "jmp.h"
+
+/* Limbs are carved out of large blocks that are never moved or freed
+ * before the vector itself, so entries stay valid while the vector grows. */
+#define JMP_VEC_BLOCK 8192
+
+/* Free lists by size class, class c holding slots of 2^c up to 2^(c+1) - 1
+ * limbs. */
+#define JMP_VEC_CLASSES 64
+
+typedef struct {
+    mp_limb_t *data;
+    size_t used;
+    size_t capacity;
+} JmpVecBlock;
+
+typedef struct {
+    mp_limb_t *limbs;
+    mp_size_t size;
+    mp_size_t alloc;
+} JmpVecEntry;
+
+/* A slot of limbs given up by an entry that outgrew it. */
+typedef struct {
+    mp_limb_t *limbs;
+    mp_size_t alloc;
+} JmpVecSlot;
+
+typedef struct {
+    JmpVecSlot *slots;
+    int32_t count;
+    int32_t capacity;
+} JmpVecFreeList;
+
+typedef struct {
+    JmpVecEntry *entries;
+    int32_t count;
+    int32_t capacity;
+    JmpVecBlock *blocks;
+    int32_t nblocks;
+    int32_t block_capacity;
+    JmpVecFreeList free[JMP_VEC_CLASSES];
+} JmpMpzVec;
+
+/* Zero has no limbs, but GMP still likes a valid pointer. */
+static mp_limb_t zero_limb = 0;
+
+static int mpzvec_gc(void *data, size_t len)
+{
+    (void) len;
+    JmpMpzVec *vec = (JmpMpzVec *)data;
+    for (int32_t i = 0; i < vec->nblocks; i++)
+        janet_free(vec->blocks[i].data);
+    janet_free(vec->blocks);
+    janet_free(vec->entries);
+    for (int32_t c = 0; c < JMP_VEC_CLASSES; c++)
+        janet_free(vec->free[c].slots);
+    return 0;
+}
+
+static void vec_entry_mpz(const JmpVecEntry *entry, mpz_ptr out) {
+    mpz_roinit_n(out, entry->limbs, entry->size);
+}
+
+static mp_limb_t *vec_alloc_limbs(JmpMpzVec *vec, size_t n) {
+    if (n == 0)
+        return &zero_limb;
+    JmpVecBlock *block = vec->nblocks > 0 ? &vec->blocks[vec->nblocks - 1] : NULL;
+    if (!block || block->capacity - block->used < n) {
+        if (vec->nblocks == vec->block_capacity) {
+            int32_t capacity = vec->block_capacity ? 2 * vec->block_capacity : 4;
+            JmpVecBlock *blocks = janet_realloc(vec->blocks, capacity * sizeof(JmpVecBlock));
+            if (!blocks) janet_panic("out of memory");
+            vec->blocks = blocks;
+            vec->block_capacity = capacity;
+        }
+        block = &vec->blocks[vec->nblocks];
+        block->capacity = n > JMP_VEC_BLOCK ? n : JMP_VEC_BLOCK;
+        block->used = 0;
+        block->data = janet_malloc(block->capacity * sizeof(mp_limb_t));
+        if (!block->data) janet_panic("out of memory");
+        vec->nblocks++;
+    }
+    mp_limb_t *limbs = block->data + block->used;
+    block->used += n;
+    return limbs;
+}
+
+/* Smallest c with 2^c >= n. */
+static int vec_class(size_t n) {
+    int c = 0;
+    while (((size_t)1 << c) < n)
+        c++;
+    return c;
+}
+
+static void vec_release(JmpMpzVec *vec, mp_limb_t *limbs, mp_size_t alloc) {
+    if (alloc == 0)
+        return;
+    int c = vec_class((size_t)alloc + 1) - 1;
+    JmpVecFreeList *list = &vec->free[c];
+    if (list->count == list->capacity) {
+        int32_t capacity = list->capacity ? 2 * list->capacity : 8;
+        JmpVecSlot *slots = janet_realloc(list->slots, capacity * sizeof(JmpVecSlot));
+        if (!slots) janet_panic("out of memory");
+        list->slots = slots;
+        list->capacity = capacity;
+    }
+    list->slots[list->count].limbs = limbs;
+    list->slots[list->count].alloc = alloc;
+    list->count++;
+}
+
+/* A released slot of at least n limbs, or a fresh one of the next power
+ * of two so an element that keeps growing is moved only logarithmically
+ * often. */
+static void vec_regrow(JmpMpzVec *vec, JmpVecEntry *entry, size_t n) {
+    int c = vec_class(n);
+    for (int k = c; k < JMP_VEC_CLASSES; k++) {
+        JmpVecFreeList *list = &vec->free[k];
+        if (list->count > 0) {
+            JmpVecSlot slot = list->slots[--list->count];
+            vec_release(vec, entry->limbs, entry->alloc);
+            entry->limbs = slot.limbs;
+            entry->alloc = slot.alloc;
+            return;
+        }
+    }
+    mp_limb_t *limbs = vec_alloc_limbs(vec, (size_t)1 << c);
+    vec_release(vec, entry->limbs, entry->alloc);
+    entry->limbs = limbs;
+    entry->alloc = (mp_size_t)1 << c;
+}
+
+/* Store x in entry, in place if the old slot is large enough. */
+static void vec_store(JmpMpzVec *vec, JmpVecEntry *entry, mpz_srcptr x) {
+    size_t n = mpz_size(x);
+    if ((mp_size_t)n > entry->alloc)
+        vec_regrow(vec, entry, n);
+    if (n > 0)
+        memmove(entry->limbs, mpz_limbs_read(x), n * sizeof(mp_limb_t));
+    entry->size = mpz_sgn(x) < 0 ? -(mp_size_t)n : (mp_size_t)n;
+}
+
+static void vec_push(JmpMpzVec *vec, mpz_srcptr x) {
+    if (vec->count == vec->capacity) {
+        if (vec->capacity > INT32_MAX / 2) janet_panic("jmp/mpzvec overflow");
+        int32_t capacity = vec->capacity ? 2 * vec->capacity : 8;
+        JmpVecEntry *entries = janet_realloc(vec->entries, capacity * sizeof(JmpVecEntry));
+        if (!entries) janet_panic("out of memory");
+        vec->entries = entries;
+        vec->capacity = capacity;
+    }
+    JmpVecEntry *entry = &vec->entries[vec->count++];
+    size_t n = mpz_size(x);
+    entry->limbs = vec_alloc_limbs(vec, n);
+    entry->alloc = (mp_size_t)n;
+    vec_store(vec, entry, x);
+}
+
+/* Push any value accepted by janet_unwrap_mpz, without a copy for jmp/mpz. */
+static void vec_push_janet(JmpMpzVec *vec, Janet x) {
+    mpz_ptr value = janet_checkabstract(x, &jmp_mpz_type);
+    if (value) {
+        vec_push(vec, value);
+    } else {
+        mpz_t tmp;
+        janet_unwrap_mpz(x, tmp);
+        vec_push(vec, tmp);
+        mpz_clear(tmp);
+    }
+}
+
+static int32_t vec_getindex(JmpMpzVec *vec, const Janet *argv, int32_t n) {
+    int32_t index = janet_getinteger(argv, n);
+    if (index < 0 || index >= vec->count)
+        janet_panicf("index %d out of range [0, %d)", index, vec->count);
+    return index;
+}
+
+/* Elements are handed out as copies, since set rewrites limbs in place. */
+static Janet vec_copy(const JmpVecEntry *entry) {
+    mpz_t x;
+    vec_entry_mpz(entry, x);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init_set(box, x);
+    return janet_wrap_abstract(box);
+}
+
+static int mpzvec_get(void *p, Janet key, Janet *out) {
+    JmpMpzVec *vec = (JmpMpzVec *)p;
+    if (!janet_checkint(key))
+        return 0;
+    int32_t index = janet_unwrap_integer(key);
+    if (index < 0 || index >= vec->count)
+        return 0;
+    *out = vec_copy(&vec->entries[index]);
+    return 1;
+}
+
+static Janet mpzvec_next(void *p, Janet key) {
+    JmpMpzVec *vec = (JmpMpzVec *)p;
+    if (janet_checktype(key, JANET_NIL))
+        return vec->count > 0 ? janet_wrap_integer(0) : janet_wrap_nil();
+    if (!janet_checkint(key))
+        return janet_wrap_nil();
+    int32_t index = janet_unwrap_integer(key) + 1;
+    if (index < 0 || index >= vec->count)
+        return janet_wrap_nil();
+    return janet_wrap_integer(index);
+}
+
+static size_t mpzvec_length(void *p, size_t len) {
+    (void) len;
+    return (size_t)((JmpMpzVec *)p)->count;
+}
+
+const JanetAbstractType jmp_mpzvec_type = {
+    "jmp/mpzvec",
+    mpzvec_gc,
+    NULL,
+    mpzvec_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    mpzvec_next,
+    NULL,
+    mpzvec_length,
+    JANET_ATEND_LENGTH
+};
+
+static JmpMpzVec *jmp_mpzvec_new(int32_t capacity) {
+    JmpMpzVec *vec = janet_abstract(&jmp_mpzvec_type, sizeof(JmpMpzVec));
+    memset(vec, 0, sizeof(JmpMpzVec));
+    if (capacity > 0) {
+        vec->entries = janet_malloc(capacity * sizeof(JmpVecEntry));
+        if (!vec->entries) janet_panic("out of memory");
+        vec->capacity = capacity;
+    }
+    return vec;
+}
+
+JANET_FN(cfun_mpzvec_new,
+         "(jmp/mpzvec &opt values)",
+         "Create a vector of integers that keeps all limbs in a few large "
+         "contiguous blocks. values is an optional indexed collection of "
+         "anything jmp/mpz accepts.") {
+    janet_arity(argc, 0, 1);
+    JanetView values = {NULL, 0};
+    if (argc > 0)
+        values = janet_getindexed(argv, 0);
+    JmpMpzVec *vec = jmp_mpzvec_new(values.len);
+    for (int32_t i = 0; i < values.len; i++)
+        vec_push_janet(vec, values.items[i]);
+    return janet_wrap_abstract(vec);
+}
+
+JANET_FN(cfun_mpzvec_push,
+         "(jmp/mpzvec-push vec & xs)",
+         "Append integers to vec. Returns vec.") {
+    janet_arity(argc, 1, -1);
+    JmpMpzVec *vec = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    for (int32_t i = 1; i < argc; i++)
+        vec_push_janet(vec, argv[i]);
+    return argv[0];
+}
+
+JANET_FN(cfun_mpzvec_get,
+         "(jmp/mpzvec-get vec index)",
+         "Copy of the element at index as a jmp/mpz. Indexing vec with get "
+         "does the same.") {
+    janet_fixarity(argc, 2);
+    JmpMpzVec *vec = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    int32_t index = vec_getindex(vec, argv, 1);
+    return vec_copy(&vec->entries[index]);
+}
+
+JANET_FN(cfun_mpzvec_set,
+         "(jmp/mpzvec-set vec index x)",
+         "Set the element at index to x. The old limbs are reused if x fits "
+         "into them. Otherwise the element moves to a slot of the next power "
+         "of two limbs and the old slot is kept for reuse by later sets. "
+         "Returns vec.") {
+    janet_fixarity(argc, 3);
+    JmpMpzVec *vec = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    int32_t index = vec_getindex(vec, argv, 1);
+    mpz_ptr value = janet_checkabstract(argv[2], &jmp_mpz_type);
+    if (value) {
+        vec_store(vec, &vec->entries[index], value);
+    } else {
+        mpz_t tmp;
+        janet_unwrap_mpz(argv[2], tmp);
+        vec_store(vec, &vec->entries[index], tmp);
+        mpz_clear(tmp);
+    }
+    return argv[0];
+}
+
+JANET_FN(cfun_mpzvec_to_array,
+         "(jmp/mpzvec->array vec)",
+         "Copy the elements of vec into a new array of jmp/mpz.") {
+    janet_fixarity(argc, 1);
+    JmpMpzVec *vec = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    JanetArray *array = janet_array(vec->count);
+    for (int32_t i = 0; i < vec->count; i++)
+        array->data[i] = vec_copy(&vec->entries[i]);
+    array->count = vec->count;
+    return janet_wrap_array(array);
+}
+
+typedef enum {
+    JMP_VEC_ADD,
+    JMP_VEC_SUB,
+    JMP_VEC_MUL
+} JmpVecOp;
+
+/* Elementwise a op b, where b is a vector of the same length or a scalar.
+ * One scratch mpz is reused for all elements. */
+static Janet mpzvec_binop(int32_t argc, Janet *argv, JmpVecOp op) {
+    janet_fixarity(argc, 2);
+    JmpMpzVec *a = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    JmpMpzVec *b = janet_checkabstract(argv[1], &jmp_mpzvec_type);
+    mpz_t scalar;
+    if (b) {
+        if (b->count != a->count)
+            janet_panicf("expected vectors of equal length, got %d and %d", a->count, b->count);
+        mpz_init(scalar);
+    } else {
+        janet_unwrap_mpz(argv[1], scalar);
+    }
+    JmpMpzVec *result = jmp_mpzvec_new(a->count);
+    mpz_t r;
+    mpz_init(r);
+    for (int32_t i = 0; i < a->count; i++) {
+        mpz_t x, y;
+        vec_entry_mpz(&a->entries[i], x);
+        if (b)
+            vec_entry_mpz(&b->entries[i], y);
+        mpz_srcptr rhs = b ? y : scalar;
+        switch (op) {
+            case JMP_VEC_ADD: mpz_add(r, x, rhs); break;
+            case JMP_VEC_SUB: mpz_sub(r, x, rhs); break;
+            case JMP_VEC_MUL: mpz_mul(r, x, rhs); break;
+        }
+        vec_push(result, r);
+    }
+    mpz_clear(r);
+    mpz_clear(scalar);
+    return janet_wrap_abstract(result);
+}
+
+JANET_FN(cfun_mpzvec_add,
+         "(jmp/mpzvec-add a b)",
+         "Elementwise sum of vector a and a vector or integer b.") {
+    return mpzvec_binop(argc, argv, JMP_VEC_ADD);
+}
+
+JANET_FN(cfun_mpzvec_sub,
+         "(jmp/mpzvec-sub a b)",
+         "Elementwise difference of vector a and a vector or integer b.") {
+    return mpzvec_binop(argc, argv, JMP_VEC_SUB);
+}
+
+JANET_FN(cfun_mpzvec_mul,
+         "(jmp/mpzvec-mul a b)",
+         "Elementwise product of vector a and a vector or integer b.") {
+    return mpzvec_binop(argc, argv, JMP_VEC_MUL);
+}
+
+JANET_FN(cfun_mpzvec_sum,
+         "(jmp/mpzvec-sum vec)",
+         "Sum of all elements of vec.") {
+    janet_fixarity(argc, 1);
+    JmpMpzVec *vec = janet_getabstract(argv, 0, &jmp_mpzvec_type);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    for (int32_t i = 0; i < vec->count; i++) {
+        mpz_t x;
+        vec_entry_mpz(&vec->entries[i], x);
+        mpz_add(box, box, x);
+    }
+    return janet_wrap_abstract(box);
+}
+
+void jmp_lib_mpzvec(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("mpzvec", cfun_mpzvec_new),
+        JANET_REG("mpzvec-push", cfun_mpzvec_push),
+        JANET_REG("mpzvec-get", cfun_mpzvec_get),
+        JANET_REG("mpzvec-set", cfun_mpzvec_set),
+        JANET_REG("mpzvec->array", cfun_mpzvec_to_array),
+        JANET_REG("mpzvec-add", cfun_mpzvec_add),
+        JANET_REG("mpzvec-sub", cfun_mpzvec_sub),
+        JANET_REG("mpzvec-mul", cfun_mpzvec_mul),
+        JANET_REG("mpzvec-sum", cfun_mpzvec_sum),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_mpzvec_type);
+}
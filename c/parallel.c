@@ -0,0 +1,75 @@
+#include "jmp.h"
+
+/* Threads use pthreads. Elsewhere, as on Windows, everything runs on the
+ * calling thread. */
+#ifndef _WIN32
+#define JMP_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+int jmp_default_threads(void) {
+#ifdef JMP_PTHREADS
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > JMP_MAX_THREADS ? JMP_MAX_THREADS : (int)cpus;
+#else
+    return 1;
+#endif
+}
+
+int jmp_optthreads(const Janet *argv, int32_t argc, int32_t n, int parallel) {
+    int32_t threads = janet_optnat(argv, argc, n, 0);
+    if (threads == 0)
+        return parallel ? jmp_default_threads() : 1;
+    return threads > JMP_MAX_THREADS ? JMP_MAX_THREADS : threads;
+}
+
+#ifdef JMP_PTHREADS
+
+typedef struct {
+    JmpRangeFn fn;
+    void *ctx;
+    int32_t lo;
+    int32_t hi;
+} JmpRangeTask;
+
+static void *range_worker(void *arg) {
+    JmpRangeTask *task = (JmpRangeTask *)arg;
+    task->fn(task->ctx, task->lo, task->hi);
+    return NULL;
+}
+
+#endif
+
+void jmp_parallel_for(int32_t lo, int32_t hi, int threads, JmpRangeFn fn, void *ctx) {
+    int32_t n = hi - lo;
+#ifndef JMP_PTHREADS
+    threads = 1;
+#endif
+    if (threads > n) threads = n;
+    if (threads <= 1) {
+        if (n > 0) fn(ctx, lo, hi);
+        return;
+    }
+#ifdef JMP_PTHREADS
+    JmpRangeTask tasks[JMP_MAX_THREADS];
+    pthread_t handles[JMP_MAX_THREADS];
+    int started[JMP_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        tasks[t].fn = fn;
+        tasks[t].ctx = ctx;
+        tasks[t].lo = lo + (int32_t)((int64_t)n * t / threads);
+        tasks[t].hi = lo + (int32_t)((int64_t)n * (t + 1) / threads);
+        started[t] = t > 0 && pthread_create(&handles[t], NULL, range_worker, &tasks[t]) == 0;
+    }
+    /* The first range, and any the system refused a thread for, run on
+     * the calling thread. */
+    for (int t = 0; t < threads; t++)
+        if (!started[t])
+            range_worker(&tasks[t]);
+    for (int t = 0; t < threads; t++)
+        if (started[t])
+            pthread_join(handles[t], NULL);
+#endif
+}
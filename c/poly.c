@@ -0,0 +1,539 @@
+#include "jmp.h"
+
+/* Below this many coefficients in the smaller factor the schoolbook
+ * product beats packing into one big integer. */
+#define JMP_POLY_KRONECKER 8
+
+/* Dense polynomial, coefficient i belongs to x^i. count is the degree plus
+ * one and the leading coefficient is never zero. alloc coefficients are
+ * initialized. A non-zero modulus makes this a polynomial over Z/mZ with
+ * all coefficients in [0, m). */
+typedef struct {
+    mpz_t *coeffs;
+    int32_t count;
+    int32_t alloc;
+    mpz_t modulus;
+} JmpPoly;
+
+static Janet cfun_poly_add(int32_t argc, Janet *argv);
+static Janet cfun_poly_sub(int32_t argc, Janet *argv);
+static Janet cfun_poly_subi(int32_t argc, Janet *argv);
+static Janet cfun_poly_mul(int32_t argc, Janet *argv);
+
+static int poly_gc(void *data, size_t len)
+{
+    (void) len;
+    JmpPoly *poly = (JmpPoly *)data;
+    for (int32_t i = 0; i < poly->alloc; i++)
+        mpz_clear(poly->coeffs[i]);
+    janet_free(poly->coeffs);
+    mpz_clear(poly->modulus);
+    return 0;
+}
+
+static JanetMethod poly_methods[] = {
+    {"+", cfun_poly_add},
+    {"r+", cfun_poly_add},
+    {"-", cfun_poly_sub},
+    {"r-", cfun_poly_subi},
+    {"*", cfun_poly_mul},
+    {"r*", cfun_poly_mul},
+    {NULL, NULL}
+};
+
+static int poly_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), poly_methods, out);
+}
+
+static Janet poly_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(poly_methods, key);
+}
+
+/* Push the decimal digits of x, without the sign if skip_sign. */
+static void push_mpz(JanetBuffer *buffer, mpz_srcptr x, int skip_sign) {
+    char *str = janet_smalloc(mpz_sizeinbase(x, 10) + 2);
+    mpz_get_str(str, 10, x);
+    janet_buffer_push_cstring(buffer, skip_sign && str[0] == '-' ? str + 1 : str);
+    janet_sfree(str);
+}
+
+static void poly_tostring(void *p, JanetBuffer *buffer) {
+    JmpPoly *poly = (JmpPoly *)p;
+    if (poly->count == 0)
+        janet_buffer_push_cstring(buffer, "0");
+    for (int32_t i = poly->count - 1; i >= 0; i--) {
+        mpz_srcptr c = poly->coeffs[i];
+        int sign = mpz_sgn(c);
+        if (sign == 0)
+            continue;
+        if (i != poly->count - 1)
+            janet_buffer_push_cstring(buffer, sign < 0 ? " - " : " + ");
+        else if (sign < 0)
+            janet_buffer_push_cstring(buffer, "-");
+        int unit = mpz_cmpabs_ui(c, 1) == 0;
+        if (!unit || i == 0)
+            push_mpz(buffer, c, 1);
+        if (i > 0) {
+            if (!unit)
+                janet_buffer_push_cstring(buffer, "*");
+            janet_buffer_push_cstring(buffer, "x");
+            if (i > 1) {
+                char exponent[16];
+                snprintf(exponent, sizeof(exponent), "^%d", (int)i);
+                janet_buffer_push_cstring(buffer, exponent);
+            }
+        }
+    }
+    if (mpz_sgn(poly->modulus) != 0) {
+        janet_buffer_push_cstring(buffer, " mod ");
+        push_mpz(buffer, poly->modulus, 0);
+    }
+}
+
+static int poly_compare(void *p1, void *p2) {
+    JmpPoly *a = (JmpPoly *)p1;
+    JmpPoly *b = (JmpPoly *)p2;
+    int c = mpz_cmp(a->modulus, b->modulus);
+    if (c != 0)
+        return c;
+    if (a->count != b->count)
+        return a->count < b->count ? -1 : 1;
+    for (int32_t i = a->count - 1; i >= 0; i--) {
+        c = mpz_cmp(a->coeffs[i], b->coeffs[i]);
+        if (c != 0)
+            return c;
+    }
+    return 0;
+}
+
+const JanetAbstractType jmp_poly_type = {
+    "jmp/poly",
+    poly_gc,
+    NULL,
+    poly_get,
+    NULL,
+    NULL,
+    NULL,
+    poly_tostring,
+    poly_compare,
+    NULL,
+    poly_next,
+    JANET_ATEND_NEXT
+};
+
+/* A polynomial with count zero coefficients. */
+static JmpPoly *poly_new(int32_t count, mpz_srcptr modulus) {
+    JmpPoly *poly = janet_abstract(&jmp_poly_type, sizeof(JmpPoly));
+    poly->coeffs = NULL;
+    poly->count = 0;
+    poly->alloc = 0;
+    mpz_init_set(poly->modulus, modulus);
+    if (count > 0) {
+        poly->coeffs = janet_malloc(count * sizeof(mpz_t));
+        if (!poly->coeffs) janet_panic("out of memory");
+        for (int32_t i = 0; i < count; i++)
+            mpz_init(poly->coeffs[i]);
+        poly->alloc = count;
+        poly->count = count;
+    }
+    return poly;
+}
+
+/* Reduce the coefficients and drop leading zeros. */
+static void poly_normalize(JmpPoly *poly) {
+    if (mpz_sgn(poly->modulus) != 0)
+        for (int32_t i = 0; i < poly->count; i++)
+            mpz_mod(poly->coeffs[i], poly->coeffs[i], poly->modulus);
+    while (poly->count > 0 && mpz_sgn(poly->coeffs[poly->count - 1]) == 0)
+        poly->count--;
+}
+
+static JmpPoly *poly_copy(const JmpPoly *src) {
+    JmpPoly *poly = poly_new(src->count, src->modulus);
+    for (int32_t i = 0; i < src->count; i++)
+        mpz_set(poly->coeffs[i], src->coeffs[i]);
+    return poly;
+}
+
+/* The constant polynomial x, for operators with an integer operand. */
+static JmpPoly *poly_coerce(Janet x, mpz_srcptr modulus) {
+    JmpPoly *poly = janet_checkabstract(x, &jmp_poly_type);
+    if (poly)
+        return poly;
+    poly = poly_new(1, modulus);
+    mpz_clear(poly->coeffs[0]);
+    janet_unwrap_mpz(x, poly->coeffs[0]);
+    poly_normalize(poly);
+    return poly;
+}
+
+static void poly_check_modulus(const JmpPoly *a, const JmpPoly *b) {
+    if (mpz_cmp(a->modulus, b->modulus) != 0)
+        janet_panic("polynomials have different moduli");
+}
+
+static JmpPoly *poly_add_sub(const JmpPoly *a, const JmpPoly *b, int subtract) {
+    poly_check_modulus(a, b);
+    int32_t count = a->count > b->count ? a->count : b->count;
+    JmpPoly *r = poly_new(count, a->modulus);
+    for (int32_t i = 0; i < count; i++) {
+        if (i < a->count)
+            mpz_set(r->coeffs[i], a->coeffs[i]);
+        if (i < b->count) {
+            if (subtract)
+                mpz_sub(r->coeffs[i], r->coeffs[i], b->coeffs[i]);
+            else
+                mpz_add(r->coeffs[i], r->coeffs[i], b->coeffs[i]);
+        }
+    }
+    poly_normalize(r);
+    return r;
+}
+
+/**************************/
+/* Kronecker substitution */
+/**************************/
+
+static size_t poly_maxbits(const JmpPoly *p) {
+    size_t bits = 0;
+    for (int32_t i = 0; i < p->count; i++) {
+        if (mpz_sgn(p->coeffs[i]) == 0)
+            continue;
+        size_t b = mpz_sizeinbase(p->coeffs[i], 2);
+        if (b > bits) bits = b;
+    }
+    return bits;
+}
+
+/* OR the n limbs at src into dst starting at bit. The target bits are
+ * zero, fields never overlap. */
+static void insert_bits(mp_limb_t *dst, size_t bit, const mp_limb_t *src, size_t n) {
+    size_t limb = bit / GMP_NUMB_BITS;
+    unsigned shift = bit % GMP_NUMB_BITS;
+    if (shift == 0) {
+        for (size_t j = 0; j < n; j++)
+            dst[limb + j] |= src[j];
+        return;
+    }
+    mp_limb_t carry = 0;
+    for (size_t j = 0; j < n; j++) {
+        dst[limb + j] |= (src[j] << shift) | carry;
+        carry = src[j] >> (GMP_NUMB_BITS - shift);
+    }
+    if (carry)
+        dst[limb + n] |= carry;
+}
+
+/* out = bits [bit, bit + k) of the n limbs at src. */
+static void extract_bits(mpz_ptr out, const mp_limb_t *src, size_t n, size_t bit, size_t k) {
+    size_t lo = bit / GMP_NUMB_BITS;
+    unsigned shift = bit % GMP_NUMB_BITS;
+    if (lo >= n) {
+        mpz_set_ui(out, 0);
+        return;
+    }
+    size_t need = (k + shift + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    if (lo + need > n) need = n - lo;
+    size_t keep = (k + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    mp_limb_t *dst = mpz_limbs_write(out, (mp_size_t)need);
+    if (shift)
+        mpn_rshift(dst, src + lo, (mp_size_t)need, shift);
+    else
+        mpn_copyi(dst, src + lo, (mp_size_t)need);
+    if (need >= keep) {
+        need = keep;
+        if (k % GMP_NUMB_BITS)
+            dst[keep - 1] &= ((mp_limb_t)1 << (k % GMP_NUMB_BITS)) - 1;
+    }
+    mpz_limbs_finish(out, (mp_size_t)need);
+}
+
+/* out = p(2^k). Positive and negative coefficients are packed separately
+ * by copying limbs and subtracted once. */
+static void kronecker_pack(mpz_ptr out, const JmpPoly *p, size_t k) {
+    size_t n = (k * (size_t)p->count + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS + 1;
+    mpz_t neg;
+    mpz_init(neg);
+    mp_limb_t *pos_limbs = mpz_limbs_write(out, (mp_size_t)n);
+    mp_limb_t *neg_limbs = mpz_limbs_write(neg, (mp_size_t)n);
+    mpn_zero(pos_limbs, (mp_size_t)n);
+    mpn_zero(neg_limbs, (mp_size_t)n);
+    for (int32_t i = 0; i < p->count; i++) {
+        mpz_srcptr c = p->coeffs[i];
+        int sign = mpz_sgn(c);
+        if (sign == 0)
+            continue;
+        insert_bits(sign > 0 ? pos_limbs : neg_limbs, k * (size_t)i, mpz_limbs_read(c), mpz_size(c));
+    }
+    mpz_limbs_finish(out, (mp_size_t)n);
+    mpz_limbs_finish(neg, (mp_size_t)n);
+    mpz_sub(out, out, neg);
+    mpz_clear(neg);
+}
+
+/* Split v into count coefficients of k bits in the balanced range
+ * (-2^(k-1), 2^(k-1)]. */
+static void kronecker_unpack(JmpPoly *r, mpz_srcptr v, size_t k) {
+    int negate = mpz_sgn(v) < 0;
+    const mp_limb_t *limbs = mpz_limbs_read(v);
+    size_t n = mpz_size(v);
+    mpz_t power;
+    mpz_init(power);
+    mpz_setbit(power, k);
+    int borrow = 0;
+    for (int32_t i = 0; i < r->count; i++) {
+        mpz_ptr c = r->coeffs[i];
+        extract_bits(c, limbs, n, k * (size_t)i, k);
+        if (borrow)
+            mpz_add_ui(c, c, 1);
+        borrow = mpz_sgn(c) != 0 && mpz_sizeinbase(c, 2) >= k;
+        if (borrow)
+            mpz_sub(c, c, power);
+        if (negate)
+            mpz_neg(c, c);
+    }
+    mpz_clear(power);
+}
+
+static JmpPoly *poly_mul(const JmpPoly *a, const JmpPoly *b) {
+    poly_check_modulus(a, b);
+    if (a->count == 0 || b->count == 0)
+        return poly_new(0, a->modulus);
+    int32_t count = a->count + b->count - 1;
+    JmpPoly *r = poly_new(count, a->modulus);
+    int32_t shorter = a->count < b->count ? a->count : b->count;
+    if (shorter < JMP_POLY_KRONECKER) {
+        for (int32_t i = 0; i < a->count; i++)
+            for (int32_t j = 0; j < b->count; j++)
+                mpz_addmul(r->coeffs[i + j], a->coeffs[i], b->coeffs[j]);
+    } else {
+        /* |product coefficient| < shorter * 2^(bits a + bits b), one more
+         * bit for the sign. */
+        size_t log = 0;
+        while (((size_t)1 << log) < (size_t)shorter) log++;
+        size_t k = poly_maxbits(a) + poly_maxbits(b) + log + 1;
+        mpz_t va, vb;
+        mpz_init(va);
+        mpz_init(vb);
+        kronecker_pack(va, a, k);
+        if (a == b) {
+            mpz_mul(va, va, va);
+        } else {
+            kronecker_pack(vb, b, k);
+            mpz_mul(va, va, vb);
+        }
+        mpz_clear(vb);
+        kronecker_unpack(r, va, k);
+        mpz_clear(va);
+    }
+    poly_normalize(r);
+    return r;
+}
+
+/* a = q * b + r with deg r < deg b. Over Z every step must divide exactly,
+ * over Z/mZ the leading coefficient of b must be invertible. */
+static void poly_divrem(const JmpPoly *a, const JmpPoly *b, JmpPoly **qout, JmpPoly **rout) {
+    poly_check_modulus(a, b);
+    if (b->count == 0)
+        janet_panic("division by zero polynomial");
+    int modular = mpz_sgn(a->modulus) != 0;
+    mpz_t inverse;
+    mpz_init(inverse);
+    mpz_srcptr lead = b->coeffs[b->count - 1];
+    if (modular && !mpz_invert(inverse, lead, a->modulus)) {
+        mpz_clear(inverse);
+        janet_panic("leading coefficient is not invertible");
+    }
+    JmpPoly *r = poly_copy(a);
+    int32_t qcount = a->count >= b->count ? a->count - b->count + 1 : 0;
+    JmpPoly *q = poly_new(qcount, a->modulus);
+    for (int32_t i = qcount - 1; i >= 0; i--) {
+        mpz_ptr top = r->coeffs[i + b->count - 1];
+        mpz_ptr c = q->coeffs[i];
+        if (modular) {
+            mpz_mul(c, top, inverse);
+            mpz_mod(c, c, a->modulus);
+        } else {
+            if (!mpz_divisible_p(top, lead)) {
+                mpz_clear(inverse);
+                janet_panic("polynomial division is not exact over the integers");
+            }
+            mpz_divexact(c, top, lead);
+        }
+        if (mpz_sgn(c) == 0)
+            continue;
+        for (int32_t j = 0; j < b->count; j++) {
+            mpz_submul(r->coeffs[i + j], c, b->coeffs[j]);
+            if (modular)
+                mpz_mod(r->coeffs[i + j], r->coeffs[i + j], a->modulus);
+        }
+    }
+    mpz_clear(inverse);
+    poly_normalize(q);
+    poly_normalize(r);
+    *qout = q;
+    *rout = r;
+}
+
+/***********/
+/* Methods */
+/***********/
+
+static Janet cfun_poly_add(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpPoly *a = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *b = poly_coerce(argv[1], a->modulus);
+    return janet_wrap_abstract(poly_add_sub(a, b, 0));
+}
+
+static Janet cfun_poly_sub(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpPoly *a = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *b = poly_coerce(argv[1], a->modulus);
+    return janet_wrap_abstract(poly_add_sub(a, b, 1));
+}
+
+static Janet cfun_poly_subi(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpPoly *a = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *b = poly_coerce(argv[1], a->modulus);
+    return janet_wrap_abstract(poly_add_sub(b, a, 1));
+}
+
+static Janet cfun_poly_mul(int32_t argc, Janet *argv) {
+    janet_fixarity(argc, 2);
+    JmpPoly *a = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *b = poly_coerce(argv[1], a->modulus);
+    return janet_wrap_abstract(poly_mul(a, b));
+}
+
+JANET_FN(cfun_poly_new,
+         "(jmp/poly coeffs &opt modulus)",
+         "Create a polynomial from an indexed collection of coefficients, "
+         "constant term first. With a modulus the polynomial is over the "
+         "integers modulo it. Supports +, - and * with polynomials and "
+         "integers.") {
+    janet_arity(argc, 1, 2);
+    JanetView coeffs = janet_getindexed(argv, 0);
+    mpz_t modulus;
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL)) {
+        janet_unwrap_mpz(argv[1], modulus);
+        if (mpz_sgn(modulus) <= 0) {
+            mpz_clear(modulus);
+            janet_panic("expected positive modulus");
+        }
+    } else {
+        mpz_init(modulus);
+    }
+    JmpPoly *poly = poly_new(coeffs.len, modulus);
+    mpz_clear(modulus);
+    for (int32_t i = 0; i < coeffs.len; i++) {
+        mpz_clear(poly->coeffs[i]);
+        janet_unwrap_mpz(coeffs.items[i], poly->coeffs[i]);
+    }
+    poly_normalize(poly);
+    return janet_wrap_abstract(poly);
+}
+
+JANET_FN(cfun_poly_coeffs,
+         "(jmp/poly-coeffs p)",
+         "Array of the coefficients of p as jmp/mpz, constant term first.") {
+    janet_fixarity(argc, 1);
+    JmpPoly *poly = janet_getabstract(argv, 0, &jmp_poly_type);
+    JanetArray *array = janet_array(poly->count);
+    for (int32_t i = 0; i < poly->count; i++) {
+        mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+        mpz_init_set(box, poly->coeffs[i]);
+        array->data[i] = janet_wrap_abstract(box);
+    }
+    array->count = poly->count;
+    return janet_wrap_array(array);
+}
+
+JANET_FN(cfun_poly_degree,
+         "(jmp/poly-degree p)",
+         "Degree of p, -1 for the zero polynomial.") {
+    janet_fixarity(argc, 1);
+    JmpPoly *poly = janet_getabstract(argv, 0, &jmp_poly_type);
+    return janet_wrap_integer(poly->count - 1);
+}
+
+JANET_FN(cfun_poly_divrem,
+         "(jmp/poly-divrem a b)",
+         "Quotient and remainder of a divided by b as a tuple [q r]. Over the "
+         "integers the division has to be exact at every step.") {
+    janet_fixarity(argc, 2);
+    JmpPoly *a = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *b = poly_coerce(argv[1], a->modulus);
+    JmpPoly *q, *r;
+    poly_divrem(a, b, &q, &r);
+    Janet *tup = janet_tuple_begin(2);
+    tup[0] = janet_wrap_abstract(q);
+    tup[1] = janet_wrap_abstract(r);
+    return janet_wrap_tuple(janet_tuple_end(tup));
+}
+
+JANET_FN(cfun_poly_eval,
+         "(jmp/poly-eval p x)",
+         "Evaluate p at the integer x with Horner's rule.") {
+    janet_fixarity(argc, 2);
+    JmpPoly *poly = janet_getabstract(argv, 0, &jmp_poly_type);
+    mpz_t x;
+    janet_unwrap_mpz(argv[1], x);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    int modular = mpz_sgn(poly->modulus) != 0;
+    for (int32_t i = poly->count - 1; i >= 0; i--) {
+        mpz_mul(box, box, x);
+        mpz_add(box, box, poly->coeffs[i]);
+        if (modular)
+            mpz_mod(box, box, poly->modulus);
+    }
+    mpz_clear(x);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_poly_mod,
+         "(jmp/poly-mod p m)",
+         "Reduce p modulo m. If m is a polynomial this is the remainder of "
+         "the division by m, otherwise the coefficients are reduced modulo "
+         "the integer m and the result is a polynomial over Z/mZ.") {
+    janet_fixarity(argc, 2);
+    JmpPoly *poly = janet_getabstract(argv, 0, &jmp_poly_type);
+    JmpPoly *divisor = janet_checkabstract(argv[1], &jmp_poly_type);
+    if (divisor) {
+        JmpPoly *q, *r;
+        poly_divrem(poly, divisor, &q, &r);
+        return janet_wrap_abstract(r);
+    }
+    mpz_t modulus;
+    janet_unwrap_mpz(argv[1], modulus);
+    if (mpz_sgn(modulus) <= 0) {
+        mpz_clear(modulus);
+        janet_panic("expected positive modulus");
+    }
+    JmpPoly *r = poly_new(poly->count, modulus);
+    mpz_clear(modulus);
+    for (int32_t i = 0; i < poly->count; i++)
+        mpz_set(r->coeffs[i], poly->coeffs[i]);
+    poly_normalize(r);
+    return janet_wrap_abstract(r);
+}
+
+void jmp_lib_poly(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("poly", cfun_poly_new),
+        JANET_REG("poly-coeffs", cfun_poly_coeffs),
+        JANET_REG("poly-degree", cfun_poly_degree),
+        JANET_REG("poly-divrem", cfun_poly_divrem),
+        JANET_REG("poly-eval", cfun_poly_eval),
+        JANET_REG("poly-mod", cfun_poly_mod),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_poly_type);
+}
@@ -0,0 +1,240 @@
+#include "jmp.h"
+
+static int randstate_gc(void *data, size_t len)
+{
+    (void) len;
+    gmp_randclear((__gmp_randstate_struct *)data);
+    return 0;
+}
+
+const JanetAbstractType jmp_randstate_type = {
+    "jmp/randstate",
+    randstate_gc,
+    JANET_ATEND_GC
+};
+
+/* Every thread gets its own default state, seeded once from the janet rng
+ * on its first use. Later calls to math/seedrandom do not affect it, only
+ * jmp/seed with a nil state reseeds it. */
+static JANET_THREAD_LOCAL int default_randstate_ready = 0;
+static JANET_THREAD_LOCAL gmp_randstate_t default_randstate;
+
+static __gmp_randstate_struct *jmp_default_randstate(void) {
+    if (!default_randstate_ready) {
+        gmp_randinit_default(default_randstate);
+        JanetRNG *rng = janet_default_rng();
+        uint32_t words[4];
+        for (int i = 0; i < 4; i++)
+            words[i] = janet_rng_u32(rng);
+        mpz_t seed;
+        mpz_init(seed);
+        mpz_import(seed, 4, 1, sizeof(uint32_t), 0, 0, words);
+        gmp_randseed(default_randstate, seed);
+        mpz_clear(seed);
+        default_randstate_ready = 1;
+    }
+    return default_randstate;
+}
+
+static __gmp_randstate_struct *jmp_optrandstate(Janet *argv, int32_t argc, int32_t n) {
+    if (argc <= n || janet_checktype(argv[n], JANET_NIL))
+        return jmp_default_randstate();
+    return (__gmp_randstate_struct *)janet_getabstract(argv, n, &jmp_randstate_type);
+}
+
+static void jmp_seed(__gmp_randstate_struct *state, Janet x) {
+    mpz_t seed;
+    janet_unwrap_mpz(x, seed);
+    gmp_randseed(state, seed);
+    mpz_clear(seed);
+}
+
+JANET_FN(cfun_randstate_new,
+         "(jmp/randstate &opt algorithm seed)",
+         "Create a random state. algorithm is one of :default, :mt (Mersenne "
+         "Twister) or :lc (linear congruential, 128 bit). If seed is given the "
+         "state is seeded with it.") {
+    janet_arity(argc, 0, 2);
+    int lc = 0;
+    if (argc > 0 && !janet_checktype(argv[0], JANET_NIL)) {
+        if (janet_keyeq(argv[0], "lc"))
+            lc = 1;
+        else if (!janet_keyeq(argv[0], "default") && !janet_keyeq(argv[0], "mt"))
+            janet_panicf("unknown random algorithm %v", argv[0]);
+    }
+    __gmp_randstate_struct *state = janet_abstract(&jmp_randstate_type, sizeof(gmp_randstate_t));
+    if (lc) {
+        /* A 128 bit size is always in GMP's table, so this can not fail. */
+        gmp_randinit_lc_2exp_size(state, 128);
+    } else {
+        /* The default algorithm is the Mersenne Twister. */
+        gmp_randinit_mt(state);
+    }
+    if (argc > 1 && !janet_checktype(argv[1], JANET_NIL))
+        jmp_seed(state, argv[1]);
+    return janet_wrap_abstract(state);
+}
+
+JANET_FN(cfun_randstate_seed,
+         "(jmp/seed state seed)",
+         "Seed a random state. A nil state seeds the default state of the current thread.") {
+    janet_fixarity(argc, 2);
+    __gmp_randstate_struct *state = jmp_optrandstate(argv, argc, 0);
+    jmp_seed(state, argv[1]);
+    return janet_wrap_nil();
+}
+
+JANET_FN(cfun_mpz_urandomb,
+         "(jmp/urandomb bits &opt state)",
+         "Uniformly distributed random integer in the range 0 to 2^bits-1. "
+         "Without state the default state of the current thread is used, which "
+         "is seeded once from the janet rng on first use; reseed it with "
+         "(jmp/seed nil seed).") {
+    janet_arity(argc, 1, 2);
+    size_t bits = janet_getsize(argv, 0);
+    __gmp_randstate_struct *state = jmp_optrandstate(argv, argc, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init2(box, bits);
+    mpz_urandomb(box, state, bits);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_urandomm,
+         "(jmp/urandomm n &opt state)",
+         "Uniformly distributed random integer in the range 0 to n-1. "
+         "Without state the default state of the current thread is used, which "
+         "is seeded once from the janet rng on first use; reseed it with "
+         "(jmp/seed nil seed).") {
+    janet_arity(argc, 1, 2);
+    __gmp_randstate_struct *state = jmp_optrandstate(argv, argc, 1);
+    mpz_t n;
+    janet_unwrap_mpz(argv[0], n);
+    if (mpz_sgn(n) <= 0) {
+        mpz_clear(n);
+        janet_panic("expected positive upper bound");
+    }
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    mpz_urandomm(box, state, n);
+    mpz_clear(n);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_mpz_rrandomb,
+         "(jmp/rrandomb bits &opt state)",
+         "Random integer with long strings of zeros and ones in its binary "
+         "representation, in the range 2^(bits-1) to 2^bits-1. Useful for "
+         "testing corner cases. "
+         "Without state the default state of the current thread is used, which "
+         "is seeded once from the janet rng on first use; reseed it with "
+         "(jmp/seed nil seed).") {
+    janet_arity(argc, 1, 2);
+    size_t bits = janet_getsize(argv, 0);
+    __gmp_randstate_struct *state = jmp_optrandstate(argv, argc, 1);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init2(box, bits);
+    mpz_rrandomb(box, state, bits);
+    return janet_wrap_abstract(box);
+}
+
+typedef enum {
+    JMP_URANDOMB,
+    JMP_URANDOMM,
+    JMP_RRANDOMB
+} JmpRandomKind;
+
+JANET_FN(cfun_random_fill,
+         "(jmp/random-fill dest kind count bound &opt state)",
+         "Generate count random integers in one call and append them to dest. "
+         "kind is one of :urandomb, :urandomm or :rrandomb and bound is the "
+         "bit count or the upper bound of the matching single value function. "
+         "If dest is an array the values are pushed as jmp/mpz. If dest is a "
+         "buffer every value is appended as a big endian byte string of fixed "
+         "width, zero padded to the size of the largest possible value. "
+         "Returns dest.") {
+    janet_arity(argc, 4, 5);
+    int is_array = janet_checktype(argv[0], JANET_ARRAY);
+    if (!is_array && !janet_checktype(argv[0], JANET_BUFFER))
+        janet_panicf("expected array or buffer, got %v", argv[0]);
+    JmpRandomKind kind;
+    if (janet_keyeq(argv[1], "urandomb")) {
+        kind = JMP_URANDOMB;
+    } else if (janet_keyeq(argv[1], "urandomm")) {
+        kind = JMP_URANDOMM;
+    } else if (janet_keyeq(argv[1], "rrandomb")) {
+        kind = JMP_RRANDOMB;
+    } else {
+        janet_panicf("unknown random kind %v", argv[1]);
+    }
+    int32_t count = janet_getnat(argv, 2);
+    __gmp_randstate_struct *state = jmp_optrandstate(argv, argc, 4);
+
+    mpz_t n;
+    size_t bits;
+    if (kind == JMP_URANDOMM) {
+        janet_unwrap_mpz(argv[3], n);
+        if (mpz_sgn(n) <= 0) {
+            mpz_clear(n);
+            janet_panic("expected positive upper bound");
+        }
+        bits = mpz_sizeinbase(n, 2);
+    } else {
+        bits = janet_getsize(argv, 3);
+        mpz_init(n);
+    }
+
+    if (is_array) {
+        JanetArray *array = janet_unwrap_array(argv[0]);
+        janet_array_ensure(array, array->count + count, 1);
+        for (int32_t i = 0; i < count; i++) {
+            mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+            mpz_init2(box, bits);
+            switch (kind) {
+                case JMP_URANDOMB: mpz_urandomb(box, state, bits); break;
+                case JMP_URANDOMM: mpz_urandomm(box, state, n); break;
+                case JMP_RRANDOMB: mpz_rrandomb(box, state, bits); break;
+            }
+            array->data[array->count++] = janet_wrap_abstract(box);
+        }
+    } else {
+        JanetBuffer *buffer = janet_unwrap_buffer(argv[0]);
+        size_t width = (bits + 7) / 8;
+        if (width != 0 && (size_t)count > (size_t)(INT32_MAX - buffer->count) / width) {
+            mpz_clear(n);
+            janet_panic("buffer overflow");
+        }
+        janet_buffer_extra(buffer, (int32_t)(width * count));
+        mpz_t value;
+        mpz_init2(value, bits);
+        for (int32_t i = 0; i < count; i++) {
+            switch (kind) {
+                case JMP_URANDOMB: mpz_urandomb(value, state, bits); break;
+                case JMP_URANDOMM: mpz_urandomm(value, state, n); break;
+                case JMP_RRANDOMB: mpz_rrandomb(value, state, bits); break;
+            }
+            uint8_t *slot = buffer->data + buffer->count;
+            size_t used = (mpz_sizeinbase(value, 2) + 7) / 8;
+            if (mpz_sgn(value) == 0) used = 0;
+            memset(slot, 0, width - used);
+            mpz_export(slot + width - used, NULL, 1, 1, 0, 0, value);
+            buffer->count += (int32_t)width;
+        }
+        mpz_clear(value);
+    }
+    mpz_clear(n);
+    return argv[0];
+}
+
+void jmp_lib_rand(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("randstate", cfun_randstate_new),
+        JANET_REG("seed", cfun_randstate_seed),
+        JANET_REG("urandomb", cfun_mpz_urandomb),
+        JANET_REG("urandomm", cfun_mpz_urandomm),
+        JANET_REG("rrandomb", cfun_mpz_rrandomb),
+        JANET_REG("random-fill", cfun_random_fill),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_randstate_type);
+}
@@ -0,0 +1,584 @@
+#include "jmp.h"
+#include <limits.h>
+
+/* Moduli must stay below this so sums of two residues fit in a word. */
+#define JMP_RNS_MAX_MODULUS (UINT64_C(1) << 62)
+
+/* A set of pairwise coprime word-size moduli m_i with product M.
+ *
+ * tree is the subproduct tree over the moduli in preorder: the node for
+ * moduli [lo, hi) is followed by the subtree for [lo, mid), then the one
+ * for [mid, hi), so a range of s moduli occupies 2s - 1 nodes and the
+ * root, tree[0], is M. inverses[i] is (M / m_i)^-1 mod m_i. */
+typedef struct {
+    int32_t count;
+    uint64_t *moduli;
+    uint64_t *inverses;
+    mpz_t *tree;
+} JmpRnsBasis;
+
+/* A value as its residues modulo each modulus of a basis. */
+typedef struct {
+    Janet basis;
+    int32_t count;
+    uint64_t residues[];
+} JmpRns;
+
+static Janet cfun_rns_add_method(int32_t argc, Janet *argv);
+static Janet cfun_rns_sub_method(int32_t argc, Janet *argv);
+static Janet cfun_rns_subi_method(int32_t argc, Janet *argv);
+static Janet cfun_rns_mul_method(int32_t argc, Janet *argv);
+
+/*********/
+/* Types */
+/*********/
+
+static int basis_gc(void *data, size_t len)
+{
+    (void) len;
+    JmpRnsBasis *basis = (JmpRnsBasis *)data;
+    if (basis->tree) {
+        for (int32_t i = 0; i < 2 * basis->count - 1; i++)
+            mpz_clear(basis->tree[i]);
+        janet_free(basis->tree);
+    }
+    janet_free(basis->moduli);
+    janet_free(basis->inverses);
+    return 0;
+}
+
+static size_t basis_length(void *p, size_t len) {
+    (void) len;
+    return (size_t)((JmpRnsBasis *)p)->count;
+}
+
+const JanetAbstractType jmp_rns_basis_type = {
+    "jmp/rns-basis",
+    basis_gc,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    basis_length,
+    JANET_ATEND_LENGTH
+};
+
+static JanetMethod rns_methods[] = {
+    {"+", cfun_rns_add_method},
+    {"r+", cfun_rns_add_method},
+    {"-", cfun_rns_sub_method},
+    {"r-", cfun_rns_subi_method},
+    {"*", cfun_rns_mul_method},
+    {"r*", cfun_rns_mul_method},
+    {NULL, NULL}
+};
+
+static int rns_gcmark(void *data, size_t len) {
+    (void) len;
+    janet_mark(((JmpRns *)data)->basis);
+    return 0;
+}
+
+static int rns_get(void *p, Janet key, Janet *out) {
+    (void) p;
+    if (!janet_checktype(key, JANET_KEYWORD))
+        return 0;
+    return janet_getmethod(janet_unwrap_keyword(key), rns_methods, out);
+}
+
+static Janet rns_next(void *p, Janet key) {
+    (void) p;
+    return janet_nextmethod(rns_methods, key);
+}
+
+static int rns_compare(void *p1, void *p2) {
+    JmpRns *a = (JmpRns *)p1;
+    JmpRns *b = (JmpRns *)p2;
+    void *ba = janet_unwrap_abstract(a->basis);
+    void *bb = janet_unwrap_abstract(b->basis);
+    if (ba != bb)
+        return ba < bb ? -1 : 1;
+    for (int32_t i = 0; i < a->count; i++)
+        if (a->residues[i] != b->residues[i])
+            return a->residues[i] < b->residues[i] ? -1 : 1;
+    return 0;
+}
+
+const JanetAbstractType jmp_rns_type = {
+    "jmp/rns",
+    NULL,
+    rns_gcmark,
+    rns_get,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    rns_compare,
+    NULL,
+    rns_next,
+    JANET_ATEND_NEXT
+};
+
+/*********************/
+/* Word size modular */
+/*********************/
+
+/* The _ui functions of GMP take an unsigned long, which is 32 bits on
+ * Windows, so moduli and residues are moved in and out with these. */
+static void word_set(mpz_ptr x, uint64_t w) {
+    mpz_import(x, 1, -1, sizeof(w), 0, 0, &w);
+}
+
+/* x must be in [0, 2^64). */
+static uint64_t word_get(mpz_srcptr x) {
+    uint64_t w = 0;
+    mpz_export(&w, NULL, -1, sizeof(w), 0, 0, x);
+    return w;
+}
+
+static uint64_t word_mod(mpz_srcptr x, uint64_t m) {
+#if ULONG_MAX >= UINT64_MAX
+    return mpz_fdiv_ui(x, (unsigned long)m);
+#else
+    mpz_t d, r;
+    mpz_init(d);
+    mpz_init(r);
+    word_set(d, m);
+    mpz_fdiv_r(r, x, d);
+    uint64_t w = word_get(r);
+    mpz_clear(r);
+    mpz_clear(d);
+    return w;
+#endif
+}
+
+static inline uint64_t mulmod(uint64_t a, uint64_t b, uint64_t m) {
+#ifdef __SIZEOF_INT128__
+    return (uint64_t)((unsigned __int128)a * b % m);
+#else
+    uint64_t r = 0;
+    a %= m;
+    while (b) {
+        if (b & 1) {
+            r += a;
+            if (r >= m) r -= m;
+        }
+        a += a;
+        if (a >= m) a -= m;
+        b >>= 1;
+    }
+    return r;
+#endif
+}
+
+/**********************/
+/* Subproduct trees   */
+/**********************/
+
+static void tree_build(mpz_t *tree, int32_t node, const uint64_t *moduli,
+                       int32_t lo, int32_t hi, int square) {
+    if (hi - lo == 1) {
+        word_set(tree[node], moduli[lo]);
+        if (square)
+            mpz_mul(tree[node], tree[node], tree[node]);
+        return;
+    }
+    int32_t mid = lo + (hi - lo) / 2;
+    int32_t right = node + 2 * (mid - lo);
+    tree_build(tree, node + 1, moduli, lo, mid, square);
+    tree_build(tree, right, moduli, mid, hi, square);
+    mpz_mul(tree[node], tree[node + 1], tree[right]);
+}
+
+/* Reduce x, already smaller than the product at node, down the tree.
+ * Leaves go to words[i] as x mod m_i, or to big[i] as x mod tree leaf. */
+static void tree_remainders(const mpz_t *tree, int32_t node, const uint64_t *moduli,
+                            int32_t lo, int32_t hi, mpz_srcptr x,
+                            uint64_t *words, mpz_t *big) {
+    if (hi - lo == 1) {
+        if (words)
+            words[lo] = word_mod(x, moduli[lo]);
+        else
+            mpz_set(big[lo], x);
+        return;
+    }
+    /* Near the leaves a word remainder is cheaper than another level. */
+    if (words && mpz_size(x) <= 2) {
+        for (int32_t i = lo; i < hi; i++)
+            words[i] = word_mod(x, moduli[i]);
+        return;
+    }
+    int32_t mid = lo + (hi - lo) / 2;
+    int32_t right = node + 2 * (mid - lo);
+    mpz_t r;
+    mpz_init(r);
+    mpz_fdiv_r(r, x, tree[node + 1]);
+    tree_remainders(tree, node + 1, moduli, lo, mid, r, words, big);
+    mpz_fdiv_r(r, x, tree[right]);
+    tree_remainders(tree, right, moduli, mid, hi, r, words, big);
+    mpz_clear(r);
+}
+
+/* Sum of v_i * P / m_i over the moduli below node, P the product at node,
+ * with v_i = r_i * inverses[i] mod m_i. At the root this is congruent to
+ * the value with residues r_i. */
+static void tree_crt(const JmpRnsBasis *basis, int32_t node, int32_t lo, int32_t hi,
+                     const uint64_t *residues, mpz_ptr out) {
+    if (hi - lo == 1) {
+        word_set(out, mulmod(residues[lo], basis->inverses[lo], basis->moduli[lo]));
+        return;
+    }
+    int32_t mid = lo + (hi - lo) / 2;
+    int32_t right = node + 2 * (mid - lo);
+    mpz_t tmp;
+    mpz_init(tmp);
+    tree_crt(basis, node + 1, lo, mid, residues, out);
+    tree_crt(basis, right, mid, hi, residues, tmp);
+    mpz_mul(out, out, basis->tree[right]);
+    mpz_addmul(out, tmp, basis->tree[node + 1]);
+    mpz_clear(tmp);
+}
+
+/*********/
+/* Basis */
+/*********/
+
+static JmpRnsBasis *basis_new(int32_t count) {
+    JmpRnsBasis *basis = janet_abstract(&jmp_rns_basis_type, sizeof(JmpRnsBasis));
+    basis->count = 0;
+    basis->tree = NULL;
+    basis->moduli = janet_malloc(count * sizeof(uint64_t));
+    basis->inverses = janet_malloc(count * sizeof(uint64_t));
+    if (!basis->moduli || !basis->inverses) janet_panic("out of memory");
+    return basis;
+}
+
+/* Build the tree and the CRT inverses once moduli are filled in. The
+ * inverses come from (M mod m_i^2) / m_i = (M / m_i) mod m_i, reduced
+ * down a tree of squares, which also catches moduli sharing a factor. */
+static void basis_finish(JmpRnsBasis *basis, int32_t count) {
+    int32_t nodes = 2 * count - 1;
+    mpz_t *tree = janet_malloc(nodes * sizeof(mpz_t));
+    mpz_t *squares = janet_smalloc(nodes * sizeof(mpz_t));
+    mpz_t *leaves = janet_smalloc(count * sizeof(mpz_t));
+    if (!tree) janet_panic("out of memory");
+    for (int32_t i = 0; i < nodes; i++) {
+        mpz_init(tree[i]);
+        mpz_init(squares[i]);
+    }
+    for (int32_t i = 0; i < count; i++)
+        mpz_init(leaves[i]);
+    basis->tree = tree;
+    basis->count = count;
+    tree_build(tree, 0, basis->moduli, 0, count, 0);
+    tree_build(squares, 0, basis->moduli, 0, count, 1);
+    tree_remainders(squares, 0, basis->moduli, 0, count, tree[0], NULL, leaves);
+    int coprime = 1;
+    mpz_t m;
+    mpz_init(m);
+    for (int32_t i = 0; i < count; i++) {
+        word_set(m, basis->moduli[i]);
+        mpz_divexact(leaves[i], leaves[i], m);
+        if (coprime && !mpz_invert(leaves[i], leaves[i], m))
+            coprime = 0;
+        basis->inverses[i] = word_get(leaves[i]);
+    }
+    mpz_clear(m);
+    for (int32_t i = 0; i < nodes; i++)
+        mpz_clear(squares[i]);
+    for (int32_t i = 0; i < count; i++)
+        mpz_clear(leaves[i]);
+    janet_sfree(squares);
+    janet_sfree(leaves);
+    if (!coprime)
+        janet_panic("moduli are not pairwise coprime");
+}
+
+static JmpRnsBasis *getbasis(const Janet *argv, int32_t n) {
+    return janet_getabstract(argv, n, &jmp_rns_basis_type);
+}
+
+/*********/
+/* Value */
+/*********/
+
+static JmpRns *rns_new(Janet basis, int32_t count) {
+    JmpRns *rns = janet_abstract(&jmp_rns_type, sizeof(JmpRns) + count * sizeof(uint64_t));
+    rns->basis = basis;
+    rns->count = count;
+    return rns;
+}
+
+static JmpRns *rns_from_mpz(Janet owner, mpz_srcptr x) {
+    JmpRnsBasis *basis = janet_unwrap_abstract(owner);
+    JmpRns *rns = rns_new(owner, basis->count);
+    mpz_t r;
+    mpz_init(r);
+    mpz_fdiv_r(r, x, basis->tree[0]);
+    tree_remainders(basis->tree, 0, basis->moduli, 0, basis->count, r, rns->residues, NULL);
+    mpz_clear(r);
+    return rns;
+}
+
+/* Another rns value over the same basis, or an integer converted to one. */
+static JmpRns *rns_coerce(Janet x, const JmpRns *like) {
+    JmpRns *rns = janet_checkabstract(x, &jmp_rns_type);
+    if (rns) {
+        if (janet_unwrap_abstract(rns->basis) != janet_unwrap_abstract(like->basis))
+            janet_panic("jmp/rns values have different bases");
+        return rns;
+    }
+    mpz_t tmp;
+    janet_unwrap_mpz(x, tmp);
+    rns = rns_from_mpz(like->basis, tmp);
+    mpz_clear(tmp);
+    return rns;
+}
+
+typedef enum {
+    JMP_RNS_ADD,
+    JMP_RNS_SUB,
+    JMP_RNS_MUL
+} JmpRnsOp;
+
+typedef struct {
+    JmpRnsOp op;
+    const uint64_t *moduli;
+    const uint64_t *a;
+    const uint64_t *b;
+    uint64_t *out;
+} JmpRnsCtx;
+
+/* Residues never carry into each other, so any range can be done alone.
+ * The add and sub loops are branch free so they vectorize. */
+static void rns_range(void *p, int32_t lo, int32_t hi) {
+    JmpRnsCtx *ctx = (JmpRnsCtx *)p;
+    const uint64_t *m = ctx->moduli, *a = ctx->a, *b = ctx->b;
+    uint64_t *out = ctx->out;
+    switch (ctx->op) {
+        case JMP_RNS_ADD:
+            for (int32_t i = lo; i < hi; i++) {
+                uint64_t s = a[i] + b[i];
+                out[i] = s >= m[i] ? s - m[i] : s;
+            }
+            break;
+        case JMP_RNS_SUB:
+            for (int32_t i = lo; i < hi; i++) {
+                uint64_t s = a[i] + (m[i] - b[i]);
+                out[i] = s >= m[i] ? s - m[i] : s;
+            }
+            break;
+        case JMP_RNS_MUL:
+            for (int32_t i = lo; i < hi; i++)
+                out[i] = mulmod(a[i], b[i], m[i]);
+            break;
+    }
+}
+
+static JmpRns *rns_op(JmpRnsOp op, const JmpRns *a, const JmpRns *b, int threads) {
+    JmpRnsBasis *basis = janet_unwrap_abstract(a->basis);
+    JmpRns *out = rns_new(a->basis, a->count);
+    JmpRnsCtx ctx = {op, basis->moduli, a->residues, b->residues, out->residues};
+    jmp_parallel_for(0, a->count, threads, rns_range, &ctx);
+    return out;
+}
+
+/***********/
+/* Methods */
+/***********/
+
+static Janet rns_method(int32_t argc, Janet *argv, JmpRnsOp op, int swap) {
+    janet_fixarity(argc, 2);
+    JmpRns *a = janet_getabstract(argv, 0, &jmp_rns_type);
+    JmpRns *b = rns_coerce(argv[1], a);
+    return janet_wrap_abstract(swap ? rns_op(op, b, a, 1) : rns_op(op, a, b, 1));
+}
+
+static Janet cfun_rns_add_method(int32_t argc, Janet *argv) {
+    return rns_method(argc, argv, JMP_RNS_ADD, 0);
+}
+
+static Janet cfun_rns_sub_method(int32_t argc, Janet *argv) {
+    return rns_method(argc, argv, JMP_RNS_SUB, 0);
+}
+
+static Janet cfun_rns_subi_method(int32_t argc, Janet *argv) {
+    return rns_method(argc, argv, JMP_RNS_SUB, 1);
+}
+
+static Janet cfun_rns_mul_method(int32_t argc, Janet *argv) {
+    return rns_method(argc, argv, JMP_RNS_MUL, 0);
+}
+
+JANET_FN(cfun_rns_basis,
+         "(jmp/rns-basis moduli)",
+         "Create a residue number system basis. moduli is either a count, "
+         "picking that many of the largest primes below 2^62, or an indexed "
+         "collection of pairwise coprime integers between 2 and 2^62. Values "
+         "in the basis are exact modulo the product of the moduli.") {
+    janet_fixarity(argc, 1);
+    if (janet_checkint(argv[0])) {
+        int32_t count = janet_getinteger(argv, 0);
+        if (count < 1)
+            janet_panicf("expected positive count, got %d", count);
+        JmpRnsBasis *basis = basis_new(count);
+        mpz_t p;
+        mpz_init(p);
+        word_set(p, JMP_RNS_MAX_MODULUS - 1);
+        for (int32_t i = 0; i < count; i++) {
+            while (!mpz_probab_prime_p(p, 30))
+                mpz_sub_ui(p, p, 2);
+            basis->moduli[i] = word_get(p);
+            mpz_sub_ui(p, p, 2);
+        }
+        mpz_clear(p);
+        basis_finish(basis, count);
+        return janet_wrap_abstract(basis);
+    }
+    JanetView moduli = janet_getindexed(argv, 0);
+    if (moduli.len < 1)
+        janet_panic("expected at least one modulus");
+    JmpRnsBasis *basis = basis_new(moduli.len);
+    for (int32_t i = 0; i < moduli.len; i++) {
+        mpz_t m;
+        janet_unwrap_mpz(moduli.items[i], m);
+        int ok = mpz_cmp_ui(m, 2) >= 0 && mpz_sizeinbase(m, 2) <= 62;
+        basis->moduli[i] = ok ? word_get(m) : 0;
+        mpz_clear(m);
+        if (!ok)
+            janet_panicf("modulus %v out of range", moduli.items[i]);
+    }
+    basis_finish(basis, moduli.len);
+    return janet_wrap_abstract(basis);
+}
+
+JANET_FN(cfun_rns_moduli,
+         "(jmp/rns-moduli basis)",
+         "Array of the moduli of basis as jmp/mpz.") {
+    janet_fixarity(argc, 1);
+    JmpRnsBasis *basis = getbasis(argv, 0);
+    JanetArray *array = janet_array(basis->count);
+    for (int32_t i = 0; i < basis->count; i++) {
+        mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+        mpz_init(box);
+        word_set(box, basis->moduli[i]);
+        array->data[i] = janet_wrap_abstract(box);
+    }
+    array->count = basis->count;
+    return janet_wrap_array(array);
+}
+
+JANET_FN(cfun_rns_modulus,
+         "(jmp/rns-modulus basis)",
+         "Product of the moduli of basis.") {
+    janet_fixarity(argc, 1);
+    JmpRnsBasis *basis = getbasis(argv, 0);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init_set(box, basis->tree[0]);
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_rns_new,
+         "(jmp/rns basis x)",
+         "Convert the integer x to its residues in basis using a remainder "
+         "tree. Supports +, - and * with jmp/rns values of the same basis "
+         "and integers.") {
+    janet_fixarity(argc, 2);
+    getbasis(argv, 0);
+    mpz_t x;
+    janet_unwrap_mpz(argv[1], x);
+    JmpRns *rns = rns_from_mpz(argv[0], x);
+    mpz_clear(x);
+    return janet_wrap_abstract(rns);
+}
+
+JANET_FN(cfun_rns_to_mpz,
+         "(jmp/rns->mpz r &opt signed)",
+         "Reconstruct the integer with residues r by the Chinese remainder "
+         "theorem over a subproduct tree. The result is in [0, M) for M the "
+         "product of the moduli, or in (-M/2, M/2] when signed is truthy.") {
+    janet_arity(argc, 1, 2);
+    JmpRns *rns = janet_getabstract(argv, 0, &jmp_rns_type);
+    int is_signed = argc > 1 && janet_truthy(argv[1]);
+    JmpRnsBasis *basis = janet_unwrap_abstract(rns->basis);
+    mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+    mpz_init(box);
+    tree_crt(basis, 0, 0, basis->count, rns->residues, box);
+    mpz_fdiv_r(box, box, basis->tree[0]);
+    if (is_signed) {
+        mpz_t half;
+        mpz_init(half);
+        mpz_fdiv_q_2exp(half, basis->tree[0], 1);
+        if (mpz_cmp(box, half) > 0)
+            mpz_sub(box, box, basis->tree[0]);
+        mpz_clear(half);
+    }
+    return janet_wrap_abstract(box);
+}
+
+JANET_FN(cfun_rns_residues,
+         "(jmp/rns-residues r)",
+         "Array of the residues of r as jmp/mpz, in the order of the moduli.") {
+    janet_fixarity(argc, 1);
+    JmpRns *rns = janet_getabstract(argv, 0, &jmp_rns_type);
+    JanetArray *array = janet_array(rns->count);
+    for (int32_t i = 0; i < rns->count; i++) {
+        mpz_ptr box = janet_abstract(&jmp_mpz_type, sizeof(mpz_t));
+        mpz_init(box);
+        word_set(box, rns->residues[i]);
+        array->data[i] = janet_wrap_abstract(box);
+    }
+    array->count = rns->count;
+    return janet_wrap_array(array);
+}
+
+static Janet rns_cfun(int32_t argc, Janet *argv, JmpRnsOp op) {
+    janet_arity(argc, 2, 3);
+    JmpRns *a = janet_getabstract(argv, 0, &jmp_rns_type);
+    JmpRns *b = rns_coerce(argv[1], a);
+    return janet_wrap_abstract(rns_op(op, a, b, jmp_optthreads(argv, argc, 2, 0)));
+}
+
+JANET_FN(cfun_rns_add,
+         "(jmp/rns-add a b &opt threads)",
+         "Residue-wise sum of a and b. With threads the residues are split "
+         "over that many threads. One word operation per residue rarely pays "
+         "for starting them, so by default a single thread is used.") {
+    return rns_cfun(argc, argv, JMP_RNS_ADD);
+}
+
+JANET_FN(cfun_rns_sub,
+         "(jmp/rns-sub a b &opt threads)",
+         "Residue-wise difference of a and b, threaded like jmp/rns-add.") {
+    return rns_cfun(argc, argv, JMP_RNS_SUB);
+}
+
+JANET_FN(cfun_rns_mul,
+         "(jmp/rns-mul a b &opt threads)",
+         "Residue-wise product of a and b, threaded like jmp/rns-add.") {
+    return rns_cfun(argc, argv, JMP_RNS_MUL);
+}
+
+void jmp_lib_rns(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("rns-basis", cfun_rns_basis),
+        JANET_REG("rns-moduli", cfun_rns_moduli),
+        JANET_REG("rns-modulus", cfun_rns_modulus),
+        JANET_REG("rns", cfun_rns_new),
+        JANET_REG("rns->mpz", cfun_rns_to_mpz),
+        JANET_REG("rns-residues", cfun_rns_residues),
+        JANET_REG("rns-add", cfun_rns_add),
+        JANET_REG("rns-sub", cfun_rns_sub),
+        JANET_REG("rns-mul", cfun_rns_mul),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+    janet_register_abstract_type(&jmp_rns_basis_type);
+    janet_register_abstract_type(&jmp_rns_type);
+}
@@ -0,0 +1,267 @@
+#include "jmp.h"
+
+/* Arrays at least this long are sorted with several threads. */
+#define JMP_SORT_PARALLEL 65536
+
+/* Everything needed to order a value, copied out of the boxes once so the
+ * counting pass never touches the limbs. */
+typedef struct {
+    mp_size_t size;
+    const mp_limb_t *limbs;
+    Janet value;
+} JmpSortItem;
+
+static int item_cmp(const void *pa, const void *pb) {
+    const JmpSortItem *a = (const JmpSortItem *)pa;
+    const JmpSortItem *b = (const JmpSortItem *)pb;
+    if (a->size != b->size)
+        return a->size < b->size ? -1 : 1;
+    if (a->size == 0)
+        return 0;
+    int c = mpn_cmp(a->limbs, b->limbs, a->size < 0 ? -a->size : a->size);
+    return a->size < 0 ? -c : c;
+}
+
+static void item_init(JmpSortItem *item, mpz_srcptr x) {
+    item->size = mpz_sgn(x) < 0 ? -(mp_size_t)mpz_size(x) : (mp_size_t)mpz_size(x);
+    item->limbs = mpz_limbs_read(x);
+}
+
+static void item_set(JmpSortItem *item, Janet value) {
+    mpz_ptr x = janet_checkabstract(value, &jmp_mpz_type);
+    if (!x)
+        janet_panicf("expected jmp/mpz, got %v", value);
+    item_init(item, x);
+    item->value = value;
+}
+
+/* A stretch of items sharing one size, sorted by a single qsort. */
+typedef struct {
+    size_t start;
+    size_t end;
+} JmpSortRange;
+
+typedef struct {
+    JmpSortItem *items;
+    const JmpSortRange *ranges;
+    const size_t *groups;
+} JmpSortCtx;
+
+/* Sort the ranges of groups lo to hi, group t holding ranges groups[t]
+ * to groups[t + 1]. */
+static void sort_groups(void *p, int32_t lo, int32_t hi) {
+    JmpSortCtx *ctx = (JmpSortCtx *)p;
+    for (size_t r = ctx->groups[lo]; r < ctx->groups[hi]; r++) {
+        const JmpSortRange *range = &ctx->ranges[r];
+        qsort(ctx->items + range->start, range->end - range->start, sizeof(JmpSortItem), item_cmp);
+    }
+}
+
+static void merge_runs(JmpSortItem *items, size_t mid, size_t n, JmpSortItem *tmp) {
+    if (mid == 0 || mid == n || item_cmp(&items[mid - 1], &items[mid]) <= 0)
+        return;
+    size_t i = 0, j = mid, k = 0;
+    while (i < mid && j < n)
+        tmp[k++] = item_cmp(&items[j], &items[i]) < 0 ? items[j++] : items[i++];
+    while (i < mid)
+        tmp[k++] = items[i++];
+    memcpy(items, tmp, k * sizeof(JmpSortItem));
+}
+
+/* Number of ranges a bucket of len items is cut into so that no single
+ * range holds much more than one thread's share. */
+static size_t bucket_pieces(size_t len, size_t share, int threads) {
+    size_t pieces = (len + share - 1) / share;
+    return pieces > (size_t)threads ? (size_t)threads : pieces;
+}
+
+static int sort_threads(size_t n, int32_t requested) {
+    if (requested > 0)
+        return requested > JMP_MAX_THREADS ? JMP_MAX_THREADS : requested;
+    return n < JMP_SORT_PARALLEL ? 1 : jmp_default_threads();
+}
+
+/* A counting pass groups the items by sign and limb count, which orders
+ * them by size without comparing any limbs. The buckets are then sorted
+ * independently, a bucket bigger than one thread's share being cut into
+ * pieces which are merged afterwards. The counts take one word per
+ * possible size, no more than the limbs of the largest values. */
+static void sort_items(JmpSortItem *items, size_t n, int threads) {
+    mp_size_t lo = items[0].size, hi = items[0].size;
+    for (size_t i = 1; i < n; i++) {
+        if (items[i].size < lo) lo = items[i].size;
+        if (items[i].size > hi) hi = items[i].size;
+    }
+    size_t buckets = (size_t)(hi - lo) + 1;
+    size_t *ends = janet_smalloc((buckets + 1) * sizeof(size_t));
+    memset(ends, 0, (buckets + 1) * sizeof(size_t));
+    for (size_t i = 0; i < n; i++)
+        ends[items[i].size - lo + 1]++;
+    for (size_t b = 1; b <= buckets; b++)
+        ends[b] += ends[b - 1];
+    /* Scattering moves ends[b] from the start of bucket b to its end. */
+    JmpSortItem *tmp = janet_smalloc(n * sizeof(JmpSortItem));
+    for (size_t i = 0; i < n; i++)
+        tmp[ends[items[i].size - lo]++] = items[i];
+    memcpy(items, tmp, n * sizeof(JmpSortItem));
+
+    if (threads < 1)
+        threads = 1;
+    size_t share = n / threads > 0 ? n / threads : 1;
+    size_t count = 0;
+    for (size_t b = 0, start = 0; b < buckets; start = ends[b++])
+        if (ends[b] - start > 1 && lo + (mp_size_t)b != 0)
+            count += bucket_pieces(ends[b] - start, share, threads);
+    JmpSortRange *ranges = janet_smalloc((count + 1) * sizeof(JmpSortRange));
+    count = 0;
+    for (size_t b = 0, start = 0; b < buckets; start = ends[b++]) {
+        size_t len = ends[b] - start;
+        if (len < 2 || lo + (mp_size_t)b == 0)
+            continue;
+        size_t pieces = bucket_pieces(len, share, threads);
+        for (size_t k = 0; k < pieces; k++) {
+            ranges[count].start = start + len * k / pieces;
+            ranges[count].end = start + len * (k + 1) / pieces;
+            count++;
+        }
+    }
+
+    /* Hand each thread consecutive ranges holding about n / threads items. */
+    size_t groups[JMP_MAX_THREADS + 1];
+    groups[0] = 0;
+    size_t r = 0;
+    for (int t = 1; t < threads; t++) {
+        size_t cut = n * (size_t)t / (size_t)threads;
+        while (r < count && ranges[r].start < cut)
+            r++;
+        groups[t] = r;
+    }
+    groups[threads] = count;
+    JmpSortCtx ctx = {items, ranges, groups};
+    jmp_parallel_for(0, threads, threads, sort_groups, &ctx);
+
+    /* Merge the pieces of any bucket that was cut, pairwise. */
+    for (size_t b = 0, start = 0; b < buckets; start = ends[b++]) {
+        size_t len = ends[b] - start;
+        if (len < 2 || lo + (mp_size_t)b == 0)
+            continue;
+        size_t runs = bucket_pieces(len, share, threads);
+        size_t bounds[JMP_MAX_THREADS + 1];
+        for (size_t k = 0; k <= runs; k++)
+            bounds[k] = len * k / runs;
+        while (runs > 1) {
+            size_t k = 0;
+            for (size_t i = 0; i < runs; i += 2) {
+                if (i + 1 < runs)
+                    merge_runs(items + start + bounds[i], bounds[i + 1] - bounds[i],
+                               bounds[i + 2] - bounds[i], tmp);
+                bounds[k++] = bounds[i];
+            }
+            bounds[k] = len;
+            runs = k;
+        }
+    }
+    janet_sfree(ranges);
+    janet_sfree(tmp);
+    janet_sfree(ends);
+}
+
+JANET_FN(cfun_mpz_sort,
+         "(jmp/sort! array &opt threads)",
+         "Sort an array of jmp/mpz in place in ascending order. Values are "
+         "grouped by sign and limb count before any limbs are compared. "
+         "Large arrays are sorted with several threads, threads overrides "
+         "their number. Returns array.") {
+    janet_arity(argc, 1, 2);
+    JanetArray *array = janet_getarray(argv, 0);
+    int32_t requested = janet_optnat(argv, argc, 1, 0);
+    size_t n = (size_t)array->count;
+    if (n < 2)
+        return argv[0];
+    JmpSortItem *items = janet_smalloc(n * sizeof(JmpSortItem));
+    for (size_t i = 0; i < n; i++)
+        item_set(&items[i], array->data[i]);
+    sort_items(items, n, sort_threads(n, requested));
+    for (size_t i = 0; i < n; i++)
+        array->data[i] = items[i].value;
+    janet_sfree(items);
+    return argv[0];
+}
+
+JANET_FN(cfun_mpz_unique,
+         "(jmp/unique! array &opt sorted)",
+         "Remove duplicate values from an array of jmp/mpz in place. The "
+         "array is sorted first unless sorted is truthy. Returns array.") {
+    janet_arity(argc, 1, 2);
+    JanetArray *array = janet_getarray(argv, 0);
+    int sorted = argc > 1 && janet_truthy(argv[1]);
+    size_t n = (size_t)array->count;
+    if (n < 2)
+        return argv[0];
+    JmpSortItem *items = janet_smalloc(n * sizeof(JmpSortItem));
+    for (size_t i = 0; i < n; i++)
+        item_set(&items[i], array->data[i]);
+    if (!sorted)
+        sort_items(items, n, sort_threads(n, 0));
+    size_t count = 1;
+    array->data[0] = items[0].value;
+    for (size_t i = 1; i < n; i++) {
+        if (item_cmp(&items[count - 1], &items[i]) != 0) {
+            items[count] = items[i];
+            array->data[count++] = items[i].value;
+        }
+    }
+    janet_sfree(items);
+    array->count = (int32_t)count;
+    return argv[0];
+}
+
+JANET_FN(cfun_mpz_bsearch,
+         "(jmp/bsearch array x)",
+         "Binary search for x in an array of jmp/mpz sorted in ascending "
+         "order. Returns the index of x, or nil if it is not present.") {
+    janet_fixarity(argc, 2);
+    JanetArray *array = janet_getarray(argv, 0);
+    JmpSortItem key;
+    mpz_t tmp;
+    mpz_ptr x = janet_checkabstract(argv[1], &jmp_mpz_type);
+    if (!x) {
+        janet_unwrap_mpz(argv[1], tmp);
+        x = tmp;
+    }
+    item_init(&key, x);
+    int32_t lo = 0, hi = array->count;
+    int32_t found = -1;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        mpz_ptr y = janet_checkabstract(array->data[mid], &jmp_mpz_type);
+        if (!y) {
+            if (x == tmp) mpz_clear(tmp);
+            janet_panicf("expected jmp/mpz, got %v", array->data[mid]);
+        }
+        JmpSortItem item;
+        item_init(&item, y);
+        int c = item_cmp(&item, &key);
+        if (c == 0) {
+            found = mid;
+            break;
+        } else if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (x == tmp)
+        mpz_clear(tmp);
+    return found < 0 ? janet_wrap_nil() : janet_wrap_integer(found);
+}
+
+void jmp_lib_sort(JanetTable *env) {
+    JanetRegExt cfuns[] = {
+        JANET_REG("sort!", cfun_mpz_sort),
+        JANET_REG("unique!", cfun_mpz_unique),
+        JANET_REG("bsearch", cfun_mpz_bsearch),
+        JANET_REG_END
+    };
+    janet_cfuns_ext(env, "jmp", cfuns);
+}